@@ -182,6 +182,255 @@ public class OSCGraphics {
 	{
 		return newText(-1, geo, 1., color, txt, font);
 	}
+
+	fun static OSCGraphicsTiles @
+	getTiles(string name)
+	{
+		OSCGraphicsTiles tiles;
+		osc_send @=> tiles.osc_send;
+		name => tiles.name;
+		return tiles;
+	}
+	fun static OSCGraphicsTiles @
+	newTiles(int pos, int geo[], float opacity, string file)
+	{
+		OSCGraphicsTiles tiles;
+
+		tiles.init(osc_send, "tiles", "s",
+			   pos, "__tiles_"+free_id, geo, opacity);
+		file => osc_send.addString;
+
+		free_id++;
+		return tiles;
+	}
+	fun static OSCGraphicsTiles @
+	newTiles(int pos, int geo[], string file)
+	{
+		return newTiles(pos, geo, 1., file);
+	}
+	fun static OSCGraphicsTiles @
+	newTiles(string file)
+	{
+		return newTiles(-1, null, 1., file);
+	}
+
+	fun static OSCGraphicsFlipbook @
+	getFlipbook(string name)
+	{
+		OSCGraphicsFlipbook flipbook;
+		osc_send @=> flipbook.osc_send;
+		name => flipbook.name;
+		return flipbook;
+	}
+	fun static OSCGraphicsFlipbook @
+	newFlipbook(int pos, int geo[], float opacity, string file)
+	{
+		OSCGraphicsFlipbook flipbook;
+
+		flipbook.init(osc_send, "flipbook", "s",
+			      pos, "__flipbook_"+free_id, geo, opacity);
+		file => osc_send.addString;
+
+		free_id++;
+		return flipbook;
+	}
+	fun static OSCGraphicsFlipbook @
+	newFlipbook(int pos, int geo[], string file)
+	{
+		return newFlipbook(pos, geo, 1., file);
+	}
+	fun static OSCGraphicsFlipbook @
+	newFlipbook(string file)
+	{
+		return newFlipbook(-1, null, 1., file);
+	}
+
+	fun static OSCGraphicsTicker @
+	getTicker(string name)
+	{
+		OSCGraphicsTicker ticker;
+		osc_send @=> ticker.osc_send;
+		name => ticker.name;
+		return ticker;
+	}
+	fun static OSCGraphicsTicker @
+	newTicker(int pos, int geo[], float opacity, int color[],
+		string txt, string font)
+	{
+		OSCGraphicsTicker ticker;
+
+		ticker.init(osc_send, "ticker", "iiiss",
+			     pos, "__ticker_"+free_id, geo, opacity);
+		for (0 => int i; i < 3; i++)
+			color[i] => osc_send.addInt;
+		txt => osc_send.addString;
+		font => osc_send.addString;
+
+		free_id++;
+		return ticker;
+	}
+	fun static OSCGraphicsTicker @
+	newTicker(int pos, int geo[], int color[], string txt, string font)
+	{
+		return newTicker(pos, geo, 1., color, txt, font);
+	}
+	fun static OSCGraphicsTicker @
+	newTicker(int geo[], int color[], string txt, string font)
+	{
+		return newTicker(-1, geo, 1., color, txt, font);
+	}
+
+	fun static OSCGraphicsRects @
+	getRects(string name)
+	{
+		OSCGraphicsRects rects;
+		osc_send @=> rects.osc_send;
+		name => rects.name;
+		return rects;
+	}
+	fun static OSCGraphicsRects @
+	newRects(int pos, int geo[], float opacity)
+	{
+		OSCGraphicsRects rects;
+
+		rects.init(osc_send, "rects", "",
+			   pos, "__rects_"+free_id, geo, opacity);
+
+		free_id++;
+		return rects;
+	}
+	fun static OSCGraphicsRects @
+	newRects(int pos, int geo[])
+	{
+		return newRects(pos, geo, 1.);
+	}
+	fun static OSCGraphicsRects @
+	newRects()
+	{
+		return newRects(-1, null, 1.);
+	}
+
+	fun static OSCGraphicsVector @
+	getVector(string name)
+	{
+		OSCGraphicsVector vector;
+		osc_send @=> vector.osc_send;
+		name => vector.name;
+		return vector;
+	}
+	fun static OSCGraphicsVector @
+	newVector(int pos, int geo[], float opacity)
+	{
+		OSCGraphicsVector vector;
+
+		vector.init(osc_send, "vector", "",
+			    pos, "__vector_"+free_id, geo, opacity);
+
+		free_id++;
+		return vector;
+	}
+	fun static OSCGraphicsVector @
+	newVector(int pos, int geo[])
+	{
+		return newVector(pos, geo, 1.);
+	}
+	fun static OSCGraphicsVector @
+	newVector()
+	{
+		return newVector(-1, null, 1.);
+	}
+
+	fun static OSCGraphicsSprites @
+	getSprites(string name)
+	{
+		OSCGraphicsSprites sprites;
+		osc_send @=> sprites.osc_send;
+		name => sprites.name;
+		return sprites;
+	}
+	fun static OSCGraphicsSprites @
+	newSprites(int pos, int geo[], float opacity, string file)
+	{
+		OSCGraphicsSprites sprites;
+
+		sprites.init(osc_send, "sprites", "s",
+			     pos, "__sprites_"+free_id, geo, opacity);
+		file => osc_send.addString;
+
+		free_id++;
+		return sprites;
+	}
+	fun static OSCGraphicsSprites @
+	newSprites(int pos, int geo[], string file)
+	{
+		return newSprites(pos, geo, 1., file);
+	}
+	fun static OSCGraphicsSprites @
+	newSprites(string file)
+	{
+		return newSprites(-1, null, 1., file);
+	}
+
+	fun static OSCGraphicsParticles @
+	getParticles(string name)
+	{
+		OSCGraphicsParticles particles;
+		osc_send @=> particles.osc_send;
+		name => particles.name;
+		return particles;
+	}
+	fun static OSCGraphicsParticles @
+	newParticles(int pos, int geo[], float opacity, string file)
+	{
+		OSCGraphicsParticles particles;
+
+		particles.init(osc_send, "particles", "s",
+			       pos, "__particles_"+free_id, geo, opacity);
+		file => osc_send.addString;
+
+		free_id++;
+		return particles;
+	}
+	fun static OSCGraphicsParticles @
+	newParticles(int pos, int geo[], string file)
+	{
+		return newParticles(pos, geo, 1., file);
+	}
+	fun static OSCGraphicsParticles @
+	newParticles(string file)
+	{
+		return newParticles(-1, null, 1., file);
+	}
+
+	fun static OSCGraphicsGroup @
+	getGroup(string name)
+	{
+		OSCGraphicsGroup group;
+		osc_send @=> group.osc_send;
+		name => group.name;
+		return group;
+	}
+	fun static OSCGraphicsGroup @
+	newGroup(int pos, int geo[], float opacity)
+	{
+		OSCGraphicsGroup group;
+
+		group.init(osc_send, "group", "",
+			   pos, "__group_"+free_id, geo, opacity);
+
+		free_id++;
+		return group;
+	}
+	fun static OSCGraphicsGroup @
+	newGroup(int pos, int geo[])
+	{
+		return newGroup(pos, geo, 1.);
+	}
+	fun static OSCGraphicsGroup @
+	newGroup()
+	{
+		return newGroup(-1, null, 1.);
+	}
 }
 /* static initialization */
 new OscSend @=> OSCGraphics.osc_send;
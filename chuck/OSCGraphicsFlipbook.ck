@@ -0,0 +1,72 @@
+public class OSCGraphicsFlipbook extends OSCGraphicsLayer {
+	/* sequence pattern like "frames/%04d.png" or sprite sheet */
+	fun string
+	file(string file)
+	{
+		osc_send.startMsg("/layer/"+name+"/file", "s");
+		file => osc_send.addString;
+
+		return file;
+	}
+
+	fun void
+	grid(int cols, int rows)
+	{
+		osc_send.startMsg("/layer/"+name+"/grid", "ii");
+		cols => osc_send.addInt;
+		rows => osc_send.addInt;
+	}
+
+	fun int
+	frames(int frames)
+	{
+		osc_send.startMsg("/layer/"+name+"/frames", "i");
+		frames => osc_send.addInt;
+
+		return frames;
+	}
+
+	class RatePort extends OSCGraphicsPort {
+		OSCGraphicsFlipbook @layer;
+
+		fun void
+		tick(float in)
+		{
+			in => layer.rate;
+		}
+	}
+	fun OSCGraphicsPort @
+	getRatePort()
+	{
+		RatePort p;
+		this @=> p.layer;
+
+		return p;
+	}
+	fun float
+	rate(float rate)
+	{
+		osc_send.startMsg("/layer/"+name+"/rate", "f");
+		rate => osc_send.addFloat;
+
+		return rate;
+	}
+
+	fun int
+	frame(int frame)
+	{
+		osc_send.startMsg("/layer/"+name+"/frame", "i");
+		frame => osc_send.addInt;
+
+		return frame;
+	}
+
+	fun int
+	loop(int loop)
+	{
+		osc_send.startMsg("/layer/"+name+"/loop", "i");
+		loop => osc_send.addInt;
+
+		return loop;
+	}
+}
@@ -0,0 +1,32 @@
+/*
+ * Geometries of adopted layers are relative to the group
+ */
+public class OSCGraphicsGroup extends OSCGraphicsLayer {
+	/* moves a top-level layer into the group */
+	fun void
+	adopt(OSCGraphicsLayer layer, int pos)
+	{
+		osc_send.startMsg("/layer/"+name+"/adopt", "si");
+		layer.name => osc_send.addString;
+		pos => osc_send.addInt;
+	}
+	fun void
+	adopt(OSCGraphicsLayer layer)
+	{
+		adopt(layer, -1);
+	}
+
+	/* moves a layer of the group back to the top level */
+	fun void
+	release(OSCGraphicsLayer layer, int pos)
+	{
+		osc_send.startMsg("/layer/"+name+"/release", "si");
+		layer.name => osc_send.addString;
+		pos => osc_send.addInt;
+	}
+	fun void
+	release(OSCGraphicsLayer layer)
+	{
+		release(layer, -1);
+	}
+}
@@ -7,4 +7,13 @@ public class OSCGraphicsImage extends OSCGraphicsLayer {
 
 		return file;
 	}
+
+	fun int
+	compositeScale(int enabled)
+	{
+		osc_send.startMsg("/layer/"+name+"/composite_scale", "i");
+		enabled => osc_send.addInt;
+
+		return enabled;
+	}
 }
@@ -91,6 +91,110 @@ public class OSCGraphicsLayer {
 		return opacity;
 	}
 
+	/*
+	 * Tweens: geometry and opacity are interpolated by osc-graphics
+	 * over duration seconds using an easing curve
+	 * ("linear", "in", "out" or "inout")
+	 */
+	fun void
+	geoTo(int geo[], float duration, string easing)
+	{
+		osc_send.startMsg("/layer/"+name+"/geo/to", "iiiifs");
+		for (0 => int i; i < 4; i++)
+			geo[i] => osc_send.addInt;
+		duration => osc_send.addFloat;
+		easing => osc_send.addString;
+	}
+	fun void
+	geoTo(int geo[], float duration)
+	{
+		geoTo(geo, duration, "linear");
+	}
+
+	fun void
+	alphaTo(float opacity, float duration, string easing)
+	{
+		osc_send.startMsg("/layer/"+name+"/alpha/to", "ffs");
+		opacity => osc_send.addFloat;
+		duration => osc_send.addFloat;
+		easing => osc_send.addString;
+	}
+	fun void
+	alphaTo(float opacity, float duration)
+	{
+		alphaTo(opacity, duration, "linear");
+	}
+
+	/*
+	 * Modulators: argument index of a numeric layer method
+	 * (e.g. "alpha" 0, "geo" 1 or "color" 2) is driven by osc-graphics.
+	 * LFO shapes are "sine", "triangle", "saw", "square" and "random".
+	 */
+	fun void
+	lfo(string method, int index, string shape,
+	    float frequency, float center, float depth, float phase)
+	{
+		osc_send.startMsg("/layer/"+name+"/lfo", "sisffff");
+		method => osc_send.addString;
+		index => osc_send.addInt;
+		shape => osc_send.addString;
+		frequency => osc_send.addFloat;
+		center => osc_send.addFloat;
+		depth => osc_send.addFloat;
+		phase => osc_send.addFloat;
+	}
+	fun void
+	lfo(string method, int index, string shape,
+	    float frequency, float center, float depth)
+	{
+		lfo(method, index, shape, frequency, center, depth, 0.);
+	}
+
+	/* times in seconds, sustain level from 0 to 1 */
+	fun void
+	envelope(string method, int index,
+		 float attack, float decay, float sustain, float release,
+		 float low, float high)
+	{
+		osc_send.startMsg("/layer/"+name+"/envelope", "siffffff");
+		method => osc_send.addString;
+		index => osc_send.addInt;
+		attack => osc_send.addFloat;
+		decay => osc_send.addFloat;
+		sustain => osc_send.addFloat;
+		release => osc_send.addFloat;
+		low => osc_send.addFloat;
+		high => osc_send.addFloat;
+	}
+
+	/* index -1 refers to all arguments of the method */
+	fun void
+	gate(string method, int index, int on)
+	{
+		osc_send.startMsg("/layer/"+name+"/gate", "sii");
+		method => osc_send.addString;
+		index => osc_send.addInt;
+		on => osc_send.addInt;
+	}
+
+	fun void
+	unmodulate(string method, int index)
+	{
+		osc_send.startMsg("/layer/"+name+"/unmodulate", "si");
+		method => osc_send.addString;
+		index => osc_send.addInt;
+	}
+
+	/* reorders the layer, -1 moves it to the top */
+	fun int
+	move(int pos)
+	{
+		osc_send.startMsg("/layer/"+name+"/move", "i");
+		pos => osc_send.addInt;
+
+		return pos;
+	}
+
 	fun void
 	delete()
 	{
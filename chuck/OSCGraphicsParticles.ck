@@ -0,0 +1,111 @@
+public class OSCGraphicsParticles extends OSCGraphicsLayer {
+	fun string
+	file(string file)
+	{
+		osc_send.startMsg("/layer/"+name+"/file", "s");
+		file => osc_send.addString;
+
+		return file;
+	}
+
+	fun void
+	emitter(int x, int y)
+	{
+		osc_send.startMsg("/layer/"+name+"/emitter", "ii");
+		x => osc_send.addInt;
+		y => osc_send.addInt;
+	}
+
+	class RatePort extends OSCGraphicsPort {
+		OSCGraphicsParticles @layer;
+
+		fun void
+		tick(float in)
+		{
+			in => layer.rate;
+		}
+	}
+	fun OSCGraphicsPort @
+	getRatePort()
+	{
+		RatePort p;
+		this @=> p.layer;
+
+		return p;
+	}
+	/* particles per second */
+	fun float
+	rate(float rate)
+	{
+		osc_send.startMsg("/layer/"+name+"/rate", "f");
+		rate => osc_send.addFloat;
+
+		return rate;
+	}
+
+	fun int
+	burst(int count)
+	{
+		osc_send.startMsg("/layer/"+name+"/burst", "i");
+		count => osc_send.addInt;
+
+		return count;
+	}
+
+	/* seconds */
+	fun float
+	lifetime(float lifetime)
+	{
+		osc_send.startMsg("/layer/"+name+"/lifetime", "f");
+		lifetime => osc_send.addFloat;
+
+		return lifetime;
+	}
+
+	/* pixels per second, degrees (counter-clockwise), degrees */
+	fun void
+	velocity(float speed, float direction, float spread)
+	{
+		osc_send.startMsg("/layer/"+name+"/velocity", "fff");
+		speed => osc_send.addFloat;
+		direction => osc_send.addFloat;
+		spread => osc_send.addFloat;
+	}
+
+	/* pixels per second^2 */
+	fun void
+	gravity(float x, float y)
+	{
+		osc_send.startMsg("/layer/"+name+"/gravity", "ff");
+		x => osc_send.addFloat;
+		y => osc_send.addFloat;
+	}
+
+	/* fraction of velocity lost per second */
+	fun float
+	drag(float drag)
+	{
+		osc_send.startMsg("/layer/"+name+"/drag", "f");
+		drag => osc_send.addFloat;
+
+		return drag;
+	}
+
+	/* scale at birth and death */
+	fun void
+	size(float start, float end)
+	{
+		osc_send.startMsg("/layer/"+name+"/size", "ff");
+		start => osc_send.addFloat;
+		end => osc_send.addFloat;
+	}
+
+	/* opacity at birth and death */
+	fun void
+	fade(float start, float end)
+	{
+		osc_send.startMsg("/layer/"+name+"/fade", "ff");
+		start => osc_send.addFloat;
+		end => osc_send.addFloat;
+	}
+}
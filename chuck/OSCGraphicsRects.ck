@@ -0,0 +1,25 @@
+public class OSCGraphicsRects extends OSCGraphicsLayer {
+	/*
+	 * ChucK cannot send blobs, so rectangles are set one at a time
+	 */
+	fun int
+	count(int count)
+	{
+		osc_send.startMsg("/layer/"+name+"/count", "i");
+		count => osc_send.addInt;
+
+		return count;
+	}
+
+	/* geo: x, y, w, h; color: r, g, b, a */
+	fun void
+	rect(int index, int geo[], int color[])
+	{
+		osc_send.startMsg("/layer/"+name+"/rect", "iiiiiiiii");
+		index => osc_send.addInt;
+		for (0 => int i; i < 4; i++)
+			geo[i] => osc_send.addInt;
+		for (0 => int i; i < 4; i++)
+			color[i] => osc_send.addInt;
+	}
+}
@@ -0,0 +1,42 @@
+public class OSCGraphicsSprites extends OSCGraphicsLayer {
+	fun string
+	file(string file)
+	{
+		osc_send.startMsg("/layer/"+name+"/file", "s");
+		file => osc_send.addString;
+
+		return file;
+	}
+
+	fun void
+	grid(int cols, int rows)
+	{
+		osc_send.startMsg("/layer/"+name+"/grid", "ii");
+		cols => osc_send.addInt;
+		rows => osc_send.addInt;
+	}
+
+	/*
+	 * ChucK cannot send blobs, so sprites are set one at a time
+	 */
+	fun int
+	count(int count)
+	{
+		osc_send.startMsg("/layer/"+name+"/count", "i");
+		count => osc_send.addInt;
+
+		return count;
+	}
+
+	fun void
+	sprite(int index, int x, int y, float scale, int cell, int alpha)
+	{
+		osc_send.startMsg("/layer/"+name+"/sprite", "iiifii");
+		index => osc_send.addInt;
+		x => osc_send.addInt;
+		y => osc_send.addInt;
+		scale => osc_send.addFloat;
+		cell => osc_send.addInt;
+		alpha => osc_send.addInt;
+	}
+}
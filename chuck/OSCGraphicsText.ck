@@ -65,6 +65,16 @@ public class OSCGraphicsText extends OSCGraphicsLayer {
 
 		return flags;
 	}
+
+	/* shrink text to the layer's width instead of stretching it */
+	fun int
+	fit(int fit)
+	{
+		osc_send.startMsg("/layer/"+name+"/fit", "i");
+		fit => osc_send.addInt;
+
+		return fit;
+	}
 }
 /* static initialization */
 (1 << 1) => OSCGraphicsText.STYLE_BOLD;
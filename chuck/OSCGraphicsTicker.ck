@@ -0,0 +1,101 @@
+public class OSCGraphicsTicker extends OSCGraphicsLayer {
+	class ColorPort extends OSCGraphicsPort {
+		OSCGraphicsTicker @layer;
+
+		int color[];
+		int index;
+
+		fun void
+		tick(float in, float prev)
+		{
+			in $ int => color[index];
+
+			/* optimize: avoid sending unnecessary messages */
+			if (color[index] != (prev $ int))
+				color => layer.color;
+		}
+	}
+	fun OSCGraphicsPort @
+	getColorPort(int color[], int index)
+	{
+		ColorPort p;
+		this @=> p.layer;
+		color @=> p.color;
+		index => p.index;
+
+		return p;
+	}
+	fun int[]
+	color(int color[])
+	{
+		osc_send.startMsg("/layer/"+name+"/color", "iii");
+		for (0 => int i; i < 3; i++)
+			color[i] => osc_send.addInt;
+
+		return color;
+	}
+
+	/* replace text */
+	fun string
+	text(string text)
+	{
+		osc_send.startMsg("/layer/"+name+"/text", "s");
+		text => osc_send.addString;
+
+		return text;
+	}
+
+	fun string
+	append(string text)
+	{
+		osc_send.startMsg("/layer/"+name+"/append", "s");
+		text => osc_send.addString;
+
+		return text;
+	}
+
+	fun string
+	font(string font)
+	{
+		osc_send.startMsg("/layer/"+name+"/font", "s");
+		font => osc_send.addString;
+
+		return font;
+	}
+
+	class SpeedPort extends OSCGraphicsPort {
+		OSCGraphicsTicker @layer;
+
+		fun void
+		tick(float in)
+		{
+			in => layer.speed;
+		}
+	}
+	fun OSCGraphicsPort @
+	getSpeedPort()
+	{
+		SpeedPort p;
+		this @=> p.layer;
+
+		return p;
+	}
+	/* pixels per second */
+	fun float
+	speed(float speed)
+	{
+		osc_send.startMsg("/layer/"+name+"/speed", "f");
+		speed => osc_send.addFloat;
+
+		return speed;
+	}
+
+	fun int
+	loop(int loop)
+	{
+		osc_send.startMsg("/layer/"+name+"/loop", "i");
+		loop => osc_send.addInt;
+
+		return loop;
+	}
+}
@@ -0,0 +1,21 @@
+public class OSCGraphicsTiles extends OSCGraphicsLayer {
+	fun string
+	file(string file)
+	{
+		osc_send.startMsg("/layer/"+name+"/file", "s");
+		file => osc_send.addString;
+
+		return file;
+	}
+
+	/* region of the full resolution image to display */
+	fun void
+	crop(int x, int y, int w, int h)
+	{
+		osc_send.startMsg("/layer/"+name+"/crop", "iiii");
+		x => osc_send.addInt;
+		y => osc_send.addInt;
+		w => osc_send.addInt;
+		h => osc_send.addInt;
+	}
+}
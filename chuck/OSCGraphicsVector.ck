@@ -0,0 +1,6 @@
+/*
+ * Display lists are sent as blobs, which ChucK cannot send,
+ * so only the common layer methods are supported
+ */
+public class OSCGraphicsVector extends OSCGraphicsLayer {
+}
@@ -68,4 +68,13 @@ public class OSCGraphicsVideo extends OSCGraphicsLayer {
 
 		return paused;
 	}
+
+	fun int
+	priority(int priority)
+	{
+		osc_send.startMsg("/layer/"+name+"/priority", "i");
+		priority => osc_send.addInt;
+
+		return priority;
+	}
 }
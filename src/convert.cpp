@@ -0,0 +1,179 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+#include <SDL_image.h>
+#include <SDL_rotozoom.h>
+
+#include "osc_graphics.h"
+#include "raw_image.h"
+
+/*
+ * This is a plain console program, so SDLmain is not used
+ */
+#ifdef main
+#undef main
+#endif
+
+/*
+ * Default values
+ */
+#define DEFAULT_BPP	32		/* bits */
+
+/*
+ * Macros
+ */
+#define SDL_IMAGE_ERROR(FMT, ...) \
+	ERROR_MSG(FMT ": %s", ##__VA_ARGS__, IMG_GetError())
+
+static void
+print_help(void)
+{
+	printf("osc-graphics-convert (%s v%s)\n"
+	       "\n"
+	       "Convert images to the raw display format, that can be loaded\n"
+	       "by image layers without decoding.\n"
+	       "\n"
+	       "Usage: osc-graphics-convert [-h] [-B <bpp>] "
+					   "[-W <width>] [-H <height>] "
+					   "<input> <output>\n"
+	       "Options:\n"
+	       "\t-h                 Show this help\n"
+	       "\t-B <bpp>           Set screen Bits per Pixel (default: %d)\n"
+	       "\t-W <width>         Scale image to width\n"
+	       "\t-H <height>        Scale image to height\n"
+	       "\n"
+	       "If only one of width and height is specified, the aspect ratio\n"
+	       "is preserved.\n",
+	       PACKAGE_NAME, PACKAGE_VERSION,
+	       DEFAULT_BPP);
+}
+
+/*
+ * Pixel format of osc-graphics' screen surface (SDL_DisplayFormat())
+ * or its alpha variant (SDL_DisplayFormatAlpha()).
+ * The channel layout is that of most X11 and Windows displays.
+ */
+static SDL_Surface *
+create_format_surface(int bpp, bool alpha)
+{
+	Uint32 Rmask, Gmask, Bmask, Amask = 0;
+
+	if (alpha) {
+		bpp = 32;
+		Amask = 0xFF000000;
+	}
+
+	switch (bpp) {
+	case 16:
+		Rmask = 0xF800;
+		Gmask = 0x07E0;
+		Bmask = 0x001F;
+		break;
+	case 24:
+	case 32:
+		Rmask = 0x00FF0000;
+		Gmask = 0x0000FF00;
+		Bmask = 0x000000FF;
+		break;
+	default:
+		return NULL;
+	}
+
+	return SDL_CreateRGBSurface(SDL_SWSURFACE, 1, 1, bpp,
+				    Rmask, Gmask, Bmask, Amask);
+}
+
+int
+main(int argc, char **argv)
+{
+	int bpp = DEFAULT_BPP;
+	int width = 0, height = 0;
+	const char *input, *output;
+
+	SDL_Surface *surf, *format_surf, *new_surf;
+
+	int i;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (strlen(argv[i]) != 2)
+			goto error;
+
+		switch (argv[i][1]) {
+		case 'h':
+			print_help();
+			return EXIT_SUCCESS;
+		case 'B':
+			if (++i == argc)
+				goto error;
+			bpp = atoi(argv[i]);
+			break;
+		case 'W':
+			if (++i == argc)
+				goto error;
+			width = atoi(argv[i]);
+			break;
+		case 'H':
+			if (++i == argc)
+				goto error;
+			height = atoi(argv[i]);
+			break;
+		default:
+			goto error;
+		}
+	}
+	if (argc - i != 2)
+		goto error;
+	input = argv[i];
+	output = argv[i+1];
+
+	surf = IMG_Load(input);
+	if (!surf) {
+		SDL_IMAGE_ERROR("IMG_Load(\"%s\")", input);
+		return EXIT_FAILURE;
+	}
+
+	if (width > 0 || height > 0) {
+		if (width <= 0)
+			width = surf->w*height/surf->h;
+		else if (height <= 0)
+			height = surf->h*width/surf->w;
+
+		new_surf = zoomSurface(surf,
+				       (double)width/surf->w,
+				       (double)height/surf->h,
+				       SMOOTHING_ON);
+		SDL_FreeSurface(surf);
+		surf = new_surf;
+	}
+
+	format_surf = create_format_surface(bpp, surf->format->Amask != 0);
+	if (!format_surf) {
+		ERROR_MSG("Unsupported Bits per Pixel: %d", bpp);
+		return EXIT_FAILURE;
+	}
+
+	new_surf = SDL_ConvertSurface(surf, format_surf->format,
+				      SDL_SWSURFACE);
+	if (!new_surf) {
+		SDL_ERROR("SDL_ConvertSurface");
+		return EXIT_FAILURE;
+	}
+	SDL_FreeSurface(format_surf);
+	SDL_FreeSurface(surf);
+
+	if (raw_image_save(new_surf, output))
+		return EXIT_FAILURE;
+
+	SDL_FreeSurface(new_surf);
+	return EXIT_SUCCESS;
+
+error:
+	print_help();
+	return EXIT_FAILURE;
+}
@@ -0,0 +1,512 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <bsd/sys/queue.h>
+#include <bsd/sys/tree.h>
+
+#ifdef __WIN32__
+#include <windows.h>
+#include <Shlwapi.h>
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <SDL.h>
+#include <SDL_rwops.h>
+#include <SDL_ttf.h>
+
+#include "osc_graphics.h"
+#include "font_pool.h"
+
+/*
+ * Macros
+ */
+#define TTF_ERROR(FMT, ...) \
+	ERROR_MSG(FMT ": %s", ##__VA_ARGS__, TTF_GetError())
+
+/* number of unreferenced fonts kept open */
+#define FONT_POOL_IDLE	16
+
+#define KERNING_UNKNOWN	(-128)
+
+/* glyph cache states */
+#define GLYPH_UNCACHED	0
+#define GLYPH_METRICS	1	/* metrics only */
+#define GLYPH_RENDERED	2	/* metrics and mask */
+
+/* one per font file */
+struct FontPoolFile {
+	RB_ENTRY(FontPoolFile) files;
+
+	char		*path;
+	void		*data;
+	size_t		size;
+	int		refs;	/* fonts opened from this file */
+};
+
+static inline int
+file_cmp(FontPoolFile *f1, FontPoolFile *f2)
+{
+	return strcmp(f1->path, f2->path);
+}
+
+static inline int
+font_cmp(FontPoolFont *f1, FontPoolFont *f2)
+{
+	int ret = strcmp(f1->file->path, f2->file->path);
+
+	if (ret)
+		return ret;
+	if (f1->size != f2->size)
+		return f1->size < f2->size ? -1 : 1;
+	return f1->style < f2->style ? -1 : f1->style > f2->style;
+}
+
+RB_GENERATE(font_pool_files, FontPoolFile, files, file_cmp);
+RB_GENERATE(font_pool_fonts, FontPoolFont, fonts, font_cmp);
+
+#ifdef HAVE_SYS_MMAN_H
+
+static void *
+map_file(const char *path, size_t *size)
+{
+	struct stat st;
+	void *data;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		ERROR_MSG("open(\"%s\"): %s", path, strerror(errno));
+		return NULL;
+	}
+	if (fstat(fd, &st) || !st.st_size) {
+		ERROR_MSG("Invalid font file \"%s\"", path);
+		close(fd);
+		return NULL;
+	}
+
+	*size = st.st_size;
+	data = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		ERROR_MSG("mmap(\"%s\"): %s", path, strerror(errno));
+		return NULL;
+	}
+
+	return data;
+}
+
+static inline void
+unmap_file(void *data, size_t size)
+{
+	munmap(data, size);
+}
+
+#else
+
+static void *
+map_file(const char *path, size_t *size)
+{
+	FILE *f;
+	long len;
+	void *data;
+
+	f = fopen(path, "rb");
+	if (!f) {
+		ERROR_MSG("fopen(\"%s\"): %s", path, strerror(errno));
+		return NULL;
+	}
+
+	if (fseek(f, 0, SEEK_END) || (len = ftell(f)) <= 0 ||
+	    fseek(f, 0, SEEK_SET)) {
+		ERROR_MSG("Invalid font file \"%s\"", path);
+		fclose(f);
+		return NULL;
+	}
+
+	*size = len;
+	data = malloc(*size);
+	if (fread(data, 1, *size, f) != *size) {
+		ERROR_MSG("fread(\"%s\"): %s", path, strerror(errno));
+		free(data);
+		data = NULL;
+	}
+	fclose(f);
+
+	return data;
+}
+
+static inline void
+unmap_file(void *data, size_t)
+{
+	free(data);
+}
+
+#endif
+
+#ifdef __WIN32__
+
+/*
+ * Resolve font file names relative to the system's font directory.
+ * Returns a newly allocated path.
+ */
+char *
+font_path(const char *file)
+{
+	char *path;
+
+	if (PathIsRelative(file)) {
+		/* relative path */
+		const char *systemroot = getenv("SYSTEMROOT");
+
+		path = (char *)malloc(strlen(systemroot) + 7 + strlen(file) + 1);
+		strcpy(path, systemroot);
+		strcat(path, "\\fonts\\");
+		strcat(path, file);
+	} else {
+		/* absolute path */
+		path = strdup(file);
+	}
+
+	return path;
+}
+
+#else /* assume POSIX */
+
+/*
+ * Resolve font file names relative to FONT_PATH.
+ * Returns a newly allocated path.
+ */
+char *
+font_path(const char *file)
+{
+	char *path;
+
+	if (*file != '/') {
+		/* relative path */
+		path = (char *)malloc(sizeof(FONT_PATH) + strlen(file));
+		strcpy(path, FONT_PATH);
+		strcat(path, file);
+	} else {
+		/* absolute path */
+		path = strdup(file);
+	}
+
+	return path;
+}
+
+#endif
+
+FontPool::FontPool() : Mutex(), num_idle(0)
+{
+	RB_INIT(&files);
+	RB_INIT(&fonts);
+	TAILQ_INIT(&idle);
+}
+
+/*
+ * Must be called after SDL_Init()
+ */
+void
+FontPool::init()
+{
+	if (TTF_Init()) {
+		TTF_ERROR("TTF_Init");
+		exit(EXIT_FAILURE);
+	}
+}
+
+FontPoolFile *
+FontPool::get_file(const char *path)
+{
+	FontPoolFile key, *file;
+
+	key.path = (char *)path;
+	file = RB_FIND(font_pool_files, &files, &key);
+	if (file)
+		return file;
+
+	file = new FontPoolFile;
+	file->data = map_file(path, &file->size);
+	if (!file->data) {
+		delete file;
+		return NULL;
+	}
+	file->path = strdup(path);
+	file->refs = 0;
+
+	RB_INSERT(font_pool_files, &files, file);
+	return file;
+}
+
+void
+FontPool::release_file(FontPoolFile *file)
+{
+	if (--file->refs)
+		return;
+
+	RB_REMOVE(font_pool_files, &files, file);
+	unmap_file(file->data, file->size);
+	free(file->path);
+	delete file;
+}
+
+void
+FontPool::close_font(FontPoolFont *font)
+{
+	RB_REMOVE(font_pool_fonts, &fonts, font);
+
+	if (font->glyphs) {
+		for (int i = 0; i < 256; i++)
+			if (font->glyph_state[i] == GLYPH_RENDERED &&
+			    font->glyphs[i].mask)
+				SDL_FreeSurface(font->glyphs[i].mask);
+		delete[] font->glyphs;
+		delete[] font->glyph_state;
+	}
+	delete[] font->kerning;
+
+	TTF_CloseFont(font->ttf);
+	release_file(font->file);
+	delete font;
+}
+
+/*
+ * Get font of the given point size and style.
+ * Returns NULL on errors, otherwise the font must be released using
+ * release().
+ */
+FontPoolFont *
+FontPool::get(const char *path, int size, int style)
+{
+	FontPoolFile file_key;
+	FontPoolFont key, *font;
+	FontPoolFile *file;
+	SDL_RWops *rw;
+
+	lock();
+
+	file_key.path = (char *)path;
+	key.file = &file_key;
+	key.size = size;
+	key.style = style;
+
+	font = RB_FIND(font_pool_fonts, &fonts, &key);
+	if (font) {
+		if (!font->refs++) {
+			TAILQ_REMOVE(&idle, font, idle);
+			num_idle--;
+		}
+		unlock();
+		return font;
+	}
+
+	file = get_file(path);
+	if (!file) {
+		unlock();
+		return NULL;
+	}
+
+	/* every font needs its own stream */
+	rw = SDL_RWFromConstMem(file->data, (int)file->size);
+	font = new FontPoolFont;
+	font->ttf = rw ? TTF_OpenFontRW(rw, 1, size) : NULL;
+	if (!font->ttf) {
+		TTF_ERROR("TTF_OpenFontRW(\"%s\", %d)", path, size);
+		delete font;
+		/* file may have been looked up for the first time */
+		file->refs++;
+		release_file(file);
+		unlock();
+		return NULL;
+	}
+	TTF_SetFontStyle(font->ttf, style);
+
+	file->refs++;
+	font->file = file;
+	font->size = size;
+	font->style = style;
+	font->refs = 1;
+	font->ascent = TTF_FontAscent(font->ttf);
+	font->height = TTF_FontHeight(font->ttf);
+	font->glyphs = NULL;
+	font->glyph_state = NULL;
+	font->kerning = NULL;
+	RB_INSERT(font_pool_fonts, &fonts, font);
+
+	unlock();
+	return font;
+}
+
+/*
+ * Get another reference to a font
+ */
+void
+FontPool::ref(FontPoolFont *font)
+{
+	lock();
+	font->refs++;
+	unlock();
+}
+
+/*
+ * Glyph metrics, measured on first use (without rasterizing the glyph)
+ */
+const FontPoolGlyph *
+FontPool::metrics(FontPoolFont *font, Uint8 ch)
+{
+	FontPoolGlyph *glyph;
+	int miny;
+
+	if (!font->glyphs) {
+		font->glyphs = new FontPoolGlyph[256];
+		font->glyph_state = new Uint8[256];
+		memset(font->glyph_state, GLYPH_UNCACHED, 256);
+	}
+
+	glyph = font->glyphs + ch;
+	if (font->glyph_state[ch] != GLYPH_UNCACHED)
+		return glyph;
+
+	if (TTF_GlyphMetrics(font->ttf, ch, &glyph->minx, &glyph->maxx,
+			     &miny, &glyph->maxy, &glyph->advance))
+		glyph->minx = glyph->maxx = glyph->maxy = glyph->advance = 0;
+	glyph->mask = NULL;
+	font->glyph_state[ch] = GLYPH_METRICS;
+
+	return glyph;
+}
+
+/*
+ * Glyph metrics and alpha coverage mask, rasterized on first use.
+ * Glyphs are never modified once rasterized, so their masks may be
+ * read without the pool locked.
+ */
+const FontPoolGlyph *
+FontPool::glyph(FontPoolFont *font, Uint8 ch)
+{
+	static const SDL_Color white = {0xFF, 0xFF, 0xFF};
+	static const SDL_Color black = {0, 0, 0};
+	FontPoolGlyph *glyph = (FontPoolGlyph *)metrics(font, ch);
+
+	if (font->glyph_state[ch] == GLYPH_RENDERED)
+		return glyph;
+
+	/*
+	 * Shaded glyphs are 8-bit surfaces whose pixel values
+	 * are the coverage
+	 */
+	glyph->mask = TTF_RenderGlyph_Shaded(font->ttf, ch, white, black);
+	font->glyph_state[ch] = GLYPH_RENDERED;
+
+	return glyph;
+}
+
+/*
+ * Width of text as composed by TextCanvas, measured from cached
+ * glyph metrics and kerning
+ */
+int
+FontPool::text_width(FontPoolFont *font, const char *text)
+{
+	int pen = 0, w = 0;
+	Uint8 prev = 0;
+
+	for (const char *p = text; *p; p++) {
+		const FontPoolGlyph *glyph = metrics(font, (Uint8)*p);
+		int right;
+
+		if (prev)
+			pen += kerning(font, prev, (Uint8)*p);
+		else if (glyph->minx < 0)
+			pen = -glyph->minx;
+
+		right = pen + (glyph->maxx > glyph->advance ?
+			       glyph->maxx : glyph->advance);
+		if (right > w)
+			w = right;
+
+		pen += glyph->advance;
+		prev = (Uint8)*p;
+	}
+
+	return w;
+}
+
+/*
+ * Horizontal kerning between two characters.
+ * SDL_ttf does not export kerning values, but applies them when
+ * measuring text, so they are derived from text sizes.
+ */
+int
+FontPool::kerning(FontPoolFont *font, Uint8 prev, Uint8 ch)
+{
+#ifdef HAVE_TTF_GETFONTKERNING
+	char pair[3] = {(char)prev, (char)ch, '\0'};
+	int pair_w, ch_w, h, kern;
+	Sint8 *entry;
+
+	if (!TTF_GetFontKerning(font->ttf))
+		return 0;
+
+	if (!font->kerning) {
+		font->kerning = new Sint8[256*256];
+		memset(font->kerning, KERNING_UNKNOWN, 256*256);
+	}
+
+	entry = font->kerning + prev*256 + ch;
+	if (*entry != KERNING_UNKNOWN)
+		return *entry;
+
+	if (TTF_SizeText(font->ttf, pair, &pair_w, &h) ||
+	    TTF_SizeText(font->ttf, pair + 1, &ch_w, &h)) {
+		kern = 0;
+	} else {
+		kern = pair_w - ch_w - metrics(font, prev)->advance;
+		if (kern <= KERNING_UNKNOWN)
+			kern = KERNING_UNKNOWN + 1;
+		else if (kern > 127)
+			kern = 127;
+	}
+
+	return *entry = (Sint8)kern;
+#else
+	return 0;
+#endif
+}
+
+void
+FontPool::release(FontPoolFont *font)
+{
+	lock();
+
+	if (!--font->refs) {
+		TAILQ_INSERT_HEAD(&idle, font, idle);
+		if (++num_idle > FONT_POOL_IDLE) {
+			FontPoolFont *last = TAILQ_LAST(&idle, font_pool_idle);
+
+			TAILQ_REMOVE(&idle, last, idle);
+			num_idle--;
+			close_font(last);
+		}
+	}
+
+	unlock();
+}
+
+FontPool::~FontPool()
+{
+	while (!RB_EMPTY(&fonts))
+		close_font(RB_MIN(font_pool_fonts, &fonts));
+}
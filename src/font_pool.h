@@ -0,0 +1,93 @@
+#ifndef __FONT_POOL_H
+#define __FONT_POOL_H
+
+#include <sys/types.h>
+#include <bsd/sys/queue.h>
+#include <bsd/sys/tree.h>
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+
+#include "osc_graphics.h"
+
+/* defined in font_pool.cpp */
+struct FontPoolFile;
+
+/*
+ * Rasterized glyph
+ */
+struct FontPoolGlyph {
+	SDL_Surface	*mask;	/* 8-bit alpha coverage or NULL if blank */
+	int		minx, maxx, maxy;
+	int		advance;
+};
+
+/*
+ * Opened font, shared by all users of the same file, size and style
+ */
+struct FontPoolFont {
+	RB_ENTRY(FontPoolFont) fonts;
+	TAILQ_ENTRY(FontPoolFont) idle;
+
+	FontPoolFile	*file;
+	int		size;
+	int		style;
+
+	TTF_Font	*ttf;
+	int		refs;
+
+	int		ascent;
+	int		height;
+
+	/* Latin-1 glyph cache, allocated on first use */
+	FontPoolGlyph	*glyphs;
+	Uint8		*glyph_state;
+	/* kerning of character pairs, KERNING_UNKNOWN if not measured yet */
+	Sint8		*kerning;
+};
+
+RB_HEAD(font_pool_files, FontPoolFile);
+RB_HEAD(font_pool_fonts, FontPoolFont);
+TAILQ_HEAD(font_pool_idle, FontPoolFont);
+
+/*
+ * Process-wide pool of reference counted fonts.
+ * Font files are memory-mapped once and shared by all sizes and styles
+ * opened from them. A few unreferenced fonts are kept open, so size
+ * animations do not reopen fonts at every step.
+ * FreeType is not thread-safe, so all TTF_*() calls on pooled fonts must
+ * be made with the pool locked.
+ */
+class FontPool : public Mutex {
+	struct font_pool_files files;
+	struct font_pool_fonts fonts;
+	struct font_pool_idle idle;
+	int num_idle;
+
+	FontPoolFile *get_file(const char *path);
+	void release_file(FontPoolFile *file);
+	void close_font(FontPoolFont *font);
+
+public:
+	FontPool();
+	~FontPool();
+
+	void init();
+
+	FontPoolFont *get(const char *path, int size,
+			  int style = TTF_STYLE_NORMAL);
+	void ref(FontPoolFont *font);
+	void release(FontPoolFont *font);
+
+	/* the pool must be locked */
+	const FontPoolGlyph *metrics(FontPoolFont *font, Uint8 ch);
+	const FontPoolGlyph *glyph(FontPoolFont *font, Uint8 ch);
+	int text_width(FontPoolFont *font, const char *text);
+	int kerning(FontPoolFont *font, Uint8 prev, Uint8 ch);
+};
+
+extern FontPool font_pool;
+
+char *font_path(const char *file);
+
+#endif
@@ -0,0 +1,689 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <bsd/sys/queue.h>
+#include <bsd/sys/tree.h>
+
+#include <SDL.h>
+#include <SDL_image.h>
+#include <SDL_rotozoom.h>
+
+#include "osc_graphics.h"
+#include "worker_pool.h"
+#include "raw_image.h"
+#include "surface.h"
+#include "image_cache.h"
+
+/*
+ * Macros
+ */
+#define SDL_IMAGE_ERROR(FMT, ...) \
+	ERROR_MSG(FMT ": %s", ##__VA_ARGS__, IMG_GetError())
+
+#define SURFACE_SIZE(SURF) \
+	((size_t)(SURF)->pitch * (SURF)->h)
+
+/* one per file and modification time */
+struct ImageCacheEntry {
+	RB_ENTRY(ImageCacheEntry) entries;
+
+	char		*path;
+	time_t		mtime;
+
+	LIST_HEAD(images_head, ImageCacheImage) images;
+};
+
+struct ImageCacheImage {
+	LIST_ENTRY(ImageCacheImage) images;
+	TAILQ_ENTRY(ImageCacheImage) lru;
+
+	ImageCacheEntry	*entry;
+	SDL_Surface	*surf;		/* NULL while compressed */
+	/*
+	 * requested size, 0 for the original,
+	 * negative mip level for the mip pyramid
+	 */
+	int		w, h;
+
+	/* memory-mapped raw image data */
+	void		*map;
+	size_t		map_size;
+
+	/*
+	 * Run-length encoded pixels of idle images.
+	 * Their surfaces are freed and recreated in the same format
+	 * when they are decoded.
+	 */
+	void		*rle;
+	size_t		rle_size;
+	Uint32		rle_flags;
+	SDL_PixelFormat	rle_format;	/* without palette */
+	int		rle_w, rle_h;
+	bool		incompressible;
+	bool		inflating;	/* rle is being decoded */
+	Uint32		last_used;	/* SDL ticks */
+
+	/* references that do not keep the image decoded */
+	int		parked;
+
+	/* references to the surface besides the cache's own */
+	inline int
+	users()
+	{
+		return surf ? surf->refcount - 1 : 0;
+	}
+};
+
+static inline int
+entry_cmp(ImageCacheEntry *e1, ImageCacheEntry *e2)
+{
+	int ret = strcmp(e1->path, e2->path);
+
+	if (ret)
+		return ret;
+
+	return e1->mtime < e2->mtime ? -1 : e1->mtime > e2->mtime;
+}
+
+RB_GENERATE(image_cache_tree, ImageCacheEntry, entries, entry_cmp);
+
+class ImageCache::CompressJob : public WorkerPool::Job {
+public:
+	CompressJob(ImageCache *cache) : WorkerPool::Job(cache) {}
+
+	void
+	run()
+	{
+		((ImageCache *)owner)->compress_idle();
+	}
+};
+
+ImageCache::ImageCache() : Mutex(), size(0), budget(0),
+			   idle_timeout(0), last_compression(0),
+			   compression_pending(false)
+{
+	RB_INIT(&entries);
+	TAILQ_INIT(&lru);
+}
+
+void
+ImageCache::set_budget(size_t bytes)
+{
+	lock();
+	budget = bytes;
+	evict();
+	unlock();
+}
+
+void
+ImageCache::set_idle_timeout(Uint32 ms)
+{
+	lock();
+	idle_timeout = ms;
+	unlock();
+}
+
+/*
+ * Find image and mark it as recently used.
+ * Compressed images are decoded, images that cannot be decoded are
+ * not found.
+ */
+ImageCacheImage *
+ImageCache::lookup(const char *path, time_t mtime, int w, int h)
+{
+	ImageCacheEntry key, *entry;
+	ImageCacheImage *image;
+
+	key.path = (char *)path;
+	key.mtime = mtime;
+
+	for (;;) {
+		entry = RB_FIND(image_cache_tree, &entries, &key);
+		if (!entry)
+			return NULL;
+
+		LIST_FOREACH(image, &entry->images, images)
+			if (image->w == w && image->h == h)
+				break;
+		if (!image)
+			return NULL;
+		if (!image->inflating)
+			break;
+
+		/*
+		 * The image may be evicted as soon as it is decoded,
+		 * so it is looked up again
+		 */
+		inflated.wait(*this);
+	}
+
+	TAILQ_REMOVE(&lru, image, lru);
+	TAILQ_INSERT_HEAD(&lru, image, lru);
+	image->last_used = SDL_GetTicks();
+	if (image->rle && !inflate(image))
+		return NULL;
+
+	return image;
+}
+
+/*
+ * Takes over one reference of surf (and the mapping if any).
+ * Does not evict, so the caller can reference surf first.
+ */
+void
+ImageCache::insert(const char *path, time_t mtime,
+		   int w, int h, SDL_Surface *surf,
+		   void *map, size_t map_size)
+{
+	ImageCacheEntry key, *entry;
+	ImageCacheImage *image;
+
+	key.path = (char *)path;
+	key.mtime = mtime;
+
+	entry = RB_FIND(image_cache_tree, &entries, &key);
+	if (!entry) {
+		entry = new ImageCacheEntry;
+		entry->path = strdup(path);
+		entry->mtime = mtime;
+		LIST_INIT(&entry->images);
+
+		RB_INSERT(image_cache_tree, &entries, entry);
+	}
+
+	image = new ImageCacheImage;
+	image->entry = entry;
+	image->surf = surf;
+	image->w = w;
+	image->h = h;
+	image->map = map;
+	image->map_size = map_size;
+	image->rle = NULL;
+	image->rle_size = 0;
+	image->incompressible = map || (surf->flags & SDL_PREALLOC) ||
+				surf->format->palette;
+	image->inflating = false;
+	image->last_used = SDL_GetTicks();
+	image->parked = 0;
+
+	LIST_INSERT_HEAD(&entry->images, image, images);
+	TAILQ_INSERT_HEAD(&lru, image, lru);
+	/* mapped pages are backed by the page cache and not accounted for */
+	if (!map)
+		size += SURFACE_SIZE(surf);
+}
+
+void
+ImageCache::free_image(ImageCacheImage *image)
+{
+	ImageCacheEntry *entry = image->entry;
+
+	TAILQ_REMOVE(&lru, image, lru);
+	LIST_REMOVE(image, images);
+	if (image->rle)
+		size -= image->rle_size;
+	else if (!image->map)
+		size -= SURFACE_SIZE(image->surf);
+	SDL_FreeSurface(image->surf);
+	raw_image_unmap(image->map, image->map_size);
+	free(image->rle);
+	delete image;
+
+	if (LIST_EMPTY(&entry->images)) {
+		RB_REMOVE(image_cache_tree, &entries, entry);
+		free(entry->path);
+		delete entry;
+	}
+}
+
+/*
+ * Free least recently used images that are referenced by the cache only
+ * until the cache fits into its budget
+ */
+void
+ImageCache::evict()
+{
+	ImageCacheImage *image, *prev;
+
+	for (image = TAILQ_LAST(&lru, image_cache_lru);
+	     image && size > budget; image = prev) {
+		prev = TAILQ_PREV(image, image_cache_lru, lru);
+
+		if (!image->users() && !image->parked && !image->inflating)
+			free_image(image);
+	}
+}
+
+/*
+ * Must be called with the cache locked, but unlocks it while decoding.
+ * Raw images (see raw_image.h) are mapped instead of decoded.
+ * Images are converted to the display format once, so blitting them
+ * does not require pixel format conversions.
+ */
+SDL_Surface *
+ImageCache::get_original(const char *path, time_t mtime)
+{
+	ImageCacheImage *image;
+	SDL_Surface *surf;
+	void *map = NULL;
+	size_t map_size = 0;
+
+	image = lookup(path, mtime, 0, 0);
+	if (image) {
+		image->surf->refcount++;
+		return image->surf;
+	}
+
+	unlock();
+	surf = raw_image_load(path, &map, &map_size);
+	if (surf && !surface_is_display_format(surf)) {
+		/* converted copy, so the mapping is no longer required */
+		SDL_Surface *new_surf = surface_display_format(surf);
+
+		if (new_surf != surf) {
+			raw_image_unmap(map, map_size);
+			map = NULL;
+			map_size = 0;
+		}
+		surf = new_surf;
+	} else if (!surf) {
+		surf = IMG_Load(path);
+		if (surf)
+			surf = surface_display_format(surf);
+		else
+			SDL_IMAGE_ERROR("IMG_Load(\"%s\")", path);
+	}
+	lock();
+
+	if (!surf)
+		return NULL;
+
+	image = lookup(path, mtime, 0, 0);
+	if (image) {
+		/* loaded concurrently */
+		SDL_FreeSurface(surf);
+		raw_image_unmap(map, map_size);
+		surf = image->surf;
+	} else {
+		insert(path, mtime, 0, 0, surf, map, map_size);
+	}
+
+	surf->refcount++;
+	evict();
+
+	return surf;
+}
+
+/*
+ * Must be called with the cache locked, but unlocks it while resampling.
+ * Level n of the mip pyramid is the original image shrunk by 2^n using
+ * a box filter. Missing levels are built from the nearest cached level
+ * above, each from the previous one, so repeated scaling to small sizes
+ * touches only a fraction of the original pixels and does not alias.
+ */
+SDL_Surface *
+ImageCache::get_mip_level(const char *path, time_t mtime,
+			  SDL_Surface *orig, int level)
+{
+	ImageCacheImage *image;
+	SDL_Surface *surf = NULL;
+	int l;
+
+	for (l = level; l > 0; l--) {
+		image = lookup(path, mtime, -l, -l);
+		if (image) {
+			surf = image->surf;
+			break;
+		}
+	}
+	if (!surf)
+		surf = orig;
+	surf->refcount++;
+
+	while (l < level) {
+		SDL_Surface *next;
+
+		unlock();
+		next = shrinkSurface(surf, 2, 2);
+		/* shrinkSurface() returns 32-bit surfaces */
+		if (next)
+			next = surface_display_format(next);
+		lock();
+
+		SDL_FreeSurface(surf);
+		if (!next)
+			return NULL;
+		l++;
+
+		image = lookup(path, mtime, -l, -l);
+		if (image) {
+			/* built concurrently */
+			SDL_FreeSurface(next);
+			next = image->surf;
+		} else {
+			insert(path, mtime, -l, -l, next, NULL, 0);
+		}
+		next->refcount++;
+		surf = next;
+	}
+
+	evict();
+	return surf;
+}
+
+/*
+ * Get image scaled to w x h, or the original image if either
+ * dimension is 0. Returns NULL on errors.
+ */
+SDL_Surface *
+ImageCache::get(const char *path, int w, int h)
+{
+	struct stat st;
+	ImageCacheImage *image;
+	SDL_Surface *orig, *surf;
+	int level;
+
+	if (stat(path, &st)) {
+		ERROR_MSG("stat(\"%s\"): %s", path, strerror(errno));
+		return NULL;
+	}
+
+	if (w <= 0 || h <= 0)
+		w = h = 0;
+
+	lock();
+
+	image = lookup(path, st.st_mtime, w, h);
+	if (image) {
+		surf = image->surf;
+		surf->refcount++;
+		unlock();
+		return surf;
+	}
+
+	orig = get_original(path, st.st_mtime);
+	if (!orig || !w || (orig->w == w && orig->h == h)) {
+		unlock();
+		return orig;
+	}
+
+	/* smallest mip level that is not smaller than w x h */
+	for (level = 0;
+	     (orig->w >> (level + 1)) >= w && (orig->h >> (level + 1)) >= h;
+	     level++);
+	if (level) {
+		SDL_Surface *mip = get_mip_level(path, st.st_mtime,
+						 orig, level);
+
+		if (mip) {
+			SDL_FreeSurface(orig);
+			orig = mip;
+		}
+	}
+
+	if (orig->w == w && orig->h == h) {
+		/* already cached as a mip level */
+		unlock();
+		return orig;
+	}
+
+	unlock();
+	surf = zoomSurface(orig, (double)w/orig->w, (double)h/orig->h,
+			   SMOOTHING_ON);
+	/* zoomSurface() may return 32-bit surfaces on 16-bit displays */
+	surf = surface_display_format(surf);
+	lock();
+
+	image = lookup(path, st.st_mtime, w, h);
+	if (image) {
+		/* scaled concurrently */
+		SDL_FreeSurface(surf);
+		surf = image->surf;
+	} else {
+		insert(path, st.st_mtime, w, h, surf, NULL, 0);
+	}
+	surf->refcount++;
+
+	SDL_FreeSurface(orig);
+	evict();
+
+	unlock();
+	return surf;
+}
+
+/*
+ * Must be called with the cache locked, but unlocks it while decoding
+ * into a new surface, so lookups of other images (and parking on the
+ * render thread) do not have to wait for the decoder.
+ * Concurrent lookups of the same image wait until it is decoded.
+ * Returns false if the image could not be decoded.
+ */
+bool
+ImageCache::inflate(ImageCacheImage *image)
+{
+	SDL_PixelFormat &fmt = image->rle_format;
+	SDL_Surface *surf;
+
+	image->inflating = true;
+
+	/* image->rle is not modified while inflating */
+	unlock();
+	surf = SDL_CreateRGBSurface(image->rle_flags,
+				    image->rle_w, image->rle_h,
+				    fmt.BitsPerPixel,
+				    fmt.Rmask, fmt.Gmask, fmt.Bmask,
+				    fmt.Amask);
+	if (surf) {
+		if (image->rle_flags & SDL_SRCCOLORKEY)
+			SDL_SetColorKey(surf, SDL_SRCCOLORKEY, fmt.colorkey);
+		if ((image->rle_flags & SDL_SRCALPHA) && !fmt.Amask)
+			SDL_SetAlpha(surf, SDL_SRCALPHA, fmt.alpha);
+		surface_rle_decode(image->rle, surf);
+	}
+	lock();
+
+	if (surf) {
+		image->surf = surf;
+		size -= image->rle_size;
+		size += SURFACE_SIZE(surf);
+		free(image->rle);
+		image->rle = NULL;
+		image->rle_size = 0;
+	} else {
+		SDL_ERROR("SDL_CreateRGBSurface");
+	}
+	image->inflating = false;
+	inflated.broadcast();
+
+	return surf != NULL;
+}
+
+/*
+ * Run-length encodes images that have been unreferenced for longer than
+ * the idle timeout, replacing their surfaces.
+ * Runs in a worker thread and does not keep the cache locked
+ * while encoding.
+ */
+void
+ImageCache::compress_idle()
+{
+	ImageCacheImage *image;
+
+	lock();
+
+	/* images are idle from when they were last seen referenced */
+	TAILQ_FOREACH(image, &lru, lru)
+		if (image->users())
+			image->last_used = SDL_GetTicks();
+
+	for (;;) {
+		Uint32 now = SDL_GetTicks();
+		SDL_Surface *surf;
+		void *data;
+		size_t data_size;
+
+		TAILQ_FOREACH_REVERSE(image, &lru, image_cache_lru, lru)
+			if (!image->rle && !image->incompressible &&
+			    !image->users() &&
+			    now - image->last_used >= idle_timeout)
+				break;
+		if (!image)
+			break;
+
+		/* our reference keeps the image from being evicted */
+		surf = image->surf;
+		surf->refcount++;
+		unlock();
+		data = surface_rle_encode(surf, &data_size);
+		lock();
+
+		if (!data) {
+			image->incompressible = true;
+		} else if (image->users() > 1) {
+			/* referenced in the meantime */
+			free(data);
+		} else {
+			size -= SURFACE_SIZE(surf);
+			size += data_size;
+			image->rle = data;
+			image->rle_size = data_size;
+			image->rle_flags = surf->flags;
+			image->rle_format = *surf->format;
+			image->rle_format.palette = NULL;
+			image->rle_w = surf->w;
+			image->rle_h = surf->h;
+
+			/* the cache's reference */
+			SDL_FreeSurface(surf);
+			image->surf = NULL;
+		}
+
+		SDL_FreeSurface(surf);
+	}
+
+	compression_pending = false;
+	unlock();
+}
+
+/*
+ * Called periodically by the render loop
+ */
+void
+ImageCache::schedule_compression()
+{
+	Uint32 now = SDL_GetTicks();
+
+	lock();
+	if (!idle_timeout || compression_pending ||
+	    now - last_compression < 1000) {
+		unlock();
+		return;
+	}
+	last_compression = now;
+	compression_pending = true;
+	unlock();
+
+	worker_pool.push(new CompressJob(this));
+}
+
+/*
+ * Must be called with the cache locked.
+ * Only used for parking, which is rare enough to search the LRU list.
+ */
+ImageCacheImage *
+ImageCache::find(SDL_Surface *surf)
+{
+	ImageCacheImage *image;
+
+	TAILQ_FOREACH(image, &lru, lru)
+		if (image->surf == surf)
+			break;
+
+	return image;
+}
+
+void
+ImageCache::release(SDL_Surface *surf)
+{
+	lock();
+	SDL_FreeSurface(surf);
+	if (size > budget)
+		evict();
+	unlock();
+}
+
+/*
+ * Parks a reference to a surface that is currently not displayed:
+ * The surface reference is released, but the returned handle keeps
+ * the image cached, possibly compressed, until it is unparked or
+ * released.
+ * Returns NULL (keeping the reference) if surf is not cached.
+ * Does not block, so it may be called by the render loop.
+ */
+ImageCacheImage *
+ImageCache::park(SDL_Surface *surf)
+{
+	ImageCacheImage *image;
+
+	lock();
+	image = find(surf);
+	if (image) {
+		image->parked++;
+		image->last_used = SDL_GetTicks();
+		SDL_FreeSurface(surf);
+	}
+	unlock();
+
+	return image;
+}
+
+/*
+ * Trades a parked reference for a reference to the image's surface,
+ * which is decoded again if it has been compressed in the meantime.
+ * Returns NULL if the image cannot be decoded.
+ * Should be called in the background, as decoding may take a while.
+ */
+SDL_Surface *
+ImageCache::unpark(ImageCacheImage *image)
+{
+	SDL_Surface *surf;
+
+	lock();
+
+	/* the parked reference keeps the image from being evicted */
+	while (image->inflating)
+		inflated.wait(*this);
+	if (image->rle)
+		inflate(image);
+
+	surf = image->surf;
+	if (surf)
+		surf->refcount++;
+	image->parked--;
+	image->last_used = SDL_GetTicks();
+
+	unlock();
+	return surf;
+}
+
+void
+ImageCache::release(ImageCacheImage *parked)
+{
+	lock();
+	parked->parked--;
+	if (size > budget)
+		evict();
+	unlock();
+}
+
+ImageCache::~ImageCache()
+{
+	while (!TAILQ_EMPTY(&lru))
+		free_image(TAILQ_FIRST(&lru));
+}
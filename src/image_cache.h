@@ -0,0 +1,84 @@
+#ifndef __IMAGE_CACHE_H
+#define __IMAGE_CACHE_H
+
+#include <sys/types.h>
+#include <bsd/sys/queue.h>
+#include <bsd/sys/tree.h>
+
+#include <SDL.h>
+
+#include "osc_graphics.h"
+
+/* defined in image_cache.cpp */
+struct ImageCacheEntry;
+struct ImageCacheImage;
+
+RB_HEAD(image_cache_tree, ImageCacheEntry);
+TAILQ_HEAD(image_cache_lru, ImageCacheImage);
+
+/*
+ * Process-wide cache of decoded images and scaled variants of them,
+ * keyed by file name and modification time.
+ * Surfaces returned by get() are shared and reference counted (using
+ * SDL's surface reference counter), so they must not be modified and
+ * must be released using release().
+ * Scaled variants are resampled from the nearest level of a mip pyramid
+ * built lazily for each image.
+ * Unreferenced surfaces are evicted in LRU order when the cache exceeds
+ * its memory budget.
+ * Optionally, surfaces that have not been referenced for some time are
+ * run-length encoded in the background, freed and decoded into new
+ * surfaces on demand.
+ * Users can park references to images they do not display, trading
+ * their surface for a handle that keeps the image cached (but possibly
+ * compressed) and cues it again without another lookup.
+ */
+class ImageCache : Mutex {
+	struct image_cache_tree entries;
+	struct image_cache_lru lru;
+
+	size_t size;	/* bytes of pixel data cached */
+	size_t budget;
+
+	Uint32 idle_timeout;	/* ms, 0 disables compression */
+	Uint32 last_compression;
+	bool compression_pending;
+
+	class CompressJob;
+	void compress_idle();
+	Cond inflated;
+	bool inflate(ImageCacheImage *image);
+
+	ImageCacheImage *find(SDL_Surface *surf);
+
+	ImageCacheImage *lookup(const char *path, time_t mtime, int w, int h);
+	void insert(const char *path, time_t mtime,
+		    int w, int h, SDL_Surface *surf,
+		    void *map, size_t map_size);
+	void free_image(ImageCacheImage *image);
+	void evict();
+
+	SDL_Surface *get_original(const char *path, time_t mtime);
+	SDL_Surface *get_mip_level(const char *path, time_t mtime,
+				   SDL_Surface *orig, int level);
+
+public:
+	ImageCache();
+	~ImageCache();
+
+	void set_budget(size_t bytes);
+	void set_idle_timeout(Uint32 ms);
+
+	void schedule_compression();
+
+	SDL_Surface *get(const char *path, int w = 0, int h = 0);
+	void release(SDL_Surface *surf);
+
+	ImageCacheImage *park(SDL_Surface *surf);
+	SDL_Surface *unpark(ImageCacheImage *image);
+	void release(ImageCacheImage *parked);
+};
+
+extern ImageCache image_cache;
+
+#endif
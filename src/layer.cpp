@@ -2,73 +2,915 @@
 #include "config.h"
 #endif
 
+#include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <bsd/sys/queue.h>
+#include <bsd/sys/tree.h>
 
 #include <SDL.h>
 
+#include <lo/lo.h>
+
 #include "osc_graphics.h"
 #include "osc_server.h"
+#include "modulator.h"
 #include "layer.h"
 
-Layer::Layer(const char *_name) : Mutex(), name(strdup(_name))
+/* smallest number of static layers worth flattening */
+#define FLATTEN_MIN_LAYERS	2
+
+/*
+ * liblo callbacks
+ */
+extern "C" {
+
+static int move_handler(const char *path, const char *types,
+			lo_arg **argv, int argc,
+			void *data, void *user_data);
+
+}
+
+/*
+ * Index of all layers by name (chained hash table).
+ * Layers are only created and deleted by the OSC server thread,
+ * but may be looked up by others.
+ */
+static Mutex name_index_mutex;
+static Layer **name_index = NULL;
+static unsigned int name_index_size = 0;	/* power of 2 */
+static unsigned int name_index_count = 0;
+
+/* FNV-1a */
+static inline unsigned int
+name_hash(const char *name)
+{
+	Uint32 hash = 2166136261U;
+
+	while (*name) {
+		hash ^= (Uint8)*name++;
+		hash *= 16777619U;
+	}
+
+	return hash;
+}
+
+static void
+name_index_add(Layer *layer)
 {
+	unsigned int bucket;
+
+	name_index_mutex.lock();
+
+	/* keep chains short by growing at a load factor of 1 */
+	if (name_index_count >= name_index_size) {
+		unsigned int new_size = name_index_size ? name_index_size*2 : 64;
+		Layer **new_index = (Layer **)calloc(new_size, sizeof(Layer *));
+
+		for (unsigned int i = 0; i < name_index_size; i++) {
+			while (name_index[i]) {
+				Layer *cur = name_index[i];
+
+				name_index[i] = cur->name_next;
+				bucket = name_hash(cur->name) & (new_size - 1);
+				cur->name_next = new_index[bucket];
+				new_index[bucket] = cur;
+			}
+		}
+
+		free(name_index);
+		name_index = new_index;
+		name_index_size = new_size;
+	}
+
+	bucket = name_hash(layer->name) & (name_index_size - 1);
+	layer->name_next = name_index[bucket];
+	name_index[bucket] = layer;
+	name_index_count++;
+
+	name_index_mutex.unlock();
+}
+
+static void
+name_index_remove(Layer *layer)
+{
+	Layer **cur;
+
+	name_index_mutex.lock();
+
+	cur = name_index + (name_hash(layer->name) & (name_index_size - 1));
+	while (*cur != layer)
+		cur = &(*cur)->name_next;
+	*cur = layer->name_next;
+	name_index_count--;
+
+	name_index_mutex.unlock();
+}
+
+Layer *
+Layer::find(const char *name)
+{
+	Layer *cur = NULL;
+
+	name_index_mutex.lock();
+
+	if (name_index_size)
+		cur = name_index[name_hash(name) & (name_index_size - 1)];
+	while (cur && strcmp(cur->name, name))
+		cur = cur->name_next;
+
+	name_index_mutex.unlock();
+
+	return cur;
+}
+
+Layer::Layer(const char *_name) : Mutex(), subtree_size(0), list(NULL),
+				   name(strdup(_name)),
+				   alpha_cur(1.),
+				   changed(true), static_frames(0)
+{
+	SLIST_INIT(&methods);
+	TAILQ_INIT(&modulators);
+
+	name_index_add(this);
+	osc_server.add_method(&move_hnd, "i", move_handler, this,
+			      "/layer/%s/move", name);
+
+	memset(&geo_cur, 0, sizeof(geo_cur));
+	geo_tween.active = false;
+	alpha_tween.active = false;
+
 	geo_osc_id = register_method("geo", GEO_TYPES, geo_osc);
 	alpha_osc_id = register_method("alpha", "f", alpha_osc);
+	geo_to_osc_id = register_method("geo/to", GEO_TYPES TWEEN_TYPES,
+					geo_to_osc);
+	alpha_to_osc_id = register_method("alpha/to", "f" TWEEN_TYPES,
+					  alpha_to_osc);
+	lfo_osc_id = register_method("lfo", "sisffff", lfo_osc);
+	envelope_osc_id = register_method("envelope", "siffffff",
+					  envelope_osc);
+	gate_osc_id = register_method("gate", "sii", gate_osc);
+	unmodulate_osc_id = register_method("unmodulate", "si",
+					    unmodulate_osc);
+}
+
+/*
+ * Remembers the geometry and opacity as if they had been set by the
+ * default methods, so tweens and modulators of single components
+ * start from them
+ */
+void
+Layer::store_geo(SDL_Rect geo)
+{
+	geo_cur = geo;
+	store_method(geo_osc_id, geo.x, geo.y, geo.w, geo.h);
+}
+
+void
+Layer::store_alpha(float opacity)
+{
+	alpha_cur = opacity;
+	store_method(alpha_osc_id, opacity);
+}
+
+void
+Layer::store_method(OSCServer::MethodHandlerId *hnd, ...)
+{
+	va_list ap;
+
+	va_start(ap, hnd);
+	((OSCServer::LayerMethod *)hnd->data)->store_v(ap);
+	va_end(ap);
+}
+
+void
+Layer::defaults(SDL_Rect geo, float opacity)
+{
+	store_geo(geo);
+	store_alpha(opacity);
+}
+
+Layer::Easing
+Layer::parse_easing(const char *name)
+{
+	if (!strcmp(name, "in"))
+		return EASING_IN;
+	if (!strcmp(name, "out"))
+		return EASING_OUT;
+	if (!strcmp(name, "inout"))
+		return EASING_IN_OUT;
+	if (*name && strcmp(name, "linear"))
+		WARNING_MSG("Unknown easing \"%s\", using linear", name);
+
+	return EASING_LINEAR;
+}
+
+void
+Layer::start_tween(Tween &tween, float duration, const char *easing)
+{
+	tween.active = true;
+	tween.start = SDL_GetTicks();
+	tween.duration = duration > 0. ? (Uint32)(duration*1000.) : 0;
+	tween.easing = parse_easing(easing);
+}
+
+/*
+ * Returns the eased progress of a tween at ticks (0 to 1)
+ * and stops it when it is complete
+ */
+float
+Layer::ease(Tween &tween, Uint32 ticks)
+{
+	/*
+	 * Tweens started while a frame is advanced begin after its ticks
+	 */
+	Sint32 elapsed = (Sint32)(ticks - tween.start);
+	float t;
+
+	if (elapsed <= 0)
+		return 0.;
+	if ((Uint32)elapsed >= tween.duration) {
+		tween.active = false;
+		return 1.;
+	}
+	t = (float)elapsed/tween.duration;
+
+	switch (tween.easing) {
+	case EASING_IN:
+		return t*t;
+	case EASING_OUT:
+		return t*(2. - t);
+	case EASING_IN_OUT:
+		return t*t*(3. - 2.*t);
+	default:
+		return t;
+	}
+}
+
+SDL_Rect
+Layer::resolve_geo(SDL_Rect geo)
+{
+	if (!geo.w)
+		geo.w = screen->w;
+	if (!geo.h)
+		geo.h = screen->h;
+
+	return geo;
+}
+
+SDL_Rect
+Layer::resolve_null_geo(SDL_Rect geo)
+{
+	if (!geo.x && !geo.y && !geo.w && !geo.h)
+		geo = (SDL_Rect){0, 0, screen->w, screen->h};
+
+	return geo;
+}
+
+void
+Layer::tween_geo(SDL_Rect geo, float duration, const char *easing)
+{
+	geo_from = resolve_geo(geo_cur);
+	geo_to = resolve_geo(geo);
+	geo_end = geo;
+	start_tween(geo_tween, duration, easing);
+}
+
+void
+Layer::tween_alpha(float opacity, float duration, const char *easing)
+{
+	alpha_from = alpha_cur;
+	alpha_to = opacity;
+	start_tween(alpha_tween, duration, easing);
+}
+
+static inline int
+lerp(int from, int to, float t)
+{
+	return from + (int)lroundf((to - from)*t);
+}
+
+/*
+ * The setters are only called when the interpolated values change
+ * visibly, since they may have to do more than storing the value
+ */
+void
+Layer::animate(Uint32 ticks)
+{
+	if (geo_tween.active) {
+		float t = ease(geo_tween, ticks);
+		SDL_Rect rect = {
+			(Sint16)lerp(geo_from.x, geo_to.x, t),
+			(Sint16)lerp(geo_from.y, geo_to.y, t),
+			(Uint16)lerp(geo_from.w, geo_to.w, t),
+			(Uint16)lerp(geo_from.h, geo_to.h, t)
+		};
+
+		/* keeps default dimensions */
+		if (!geo_tween.active)
+			rect = geo_end;
+
+		if (memcmp(&rect, &geo_cur, sizeof(rect))) {
+			store_geo(rect);
+			geo(rect);
+			changed = true;
+		}
+	}
+
+	if (alpha_tween.active) {
+		float t = ease(alpha_tween, ticks);
+		float opacity = alpha_from + (alpha_to - alpha_from)*t;
+
+		if (ceilf(opacity*SDL_ALPHA_OPAQUE) !=
+		    ceilf(alpha_cur*SDL_ALPHA_OPAQUE) || !alpha_tween.active) {
+			store_alpha(opacity);
+			alpha(opacity);
+			changed = true;
+		}
+	}
+
+	modulate(ticks);
+}
+
+/*
+ * Looks up a method that can be modulated by name
+ */
+OSCServer::LayerMethod *
+Layer::find_method(const char *method, int index)
+{
+	OSCServer::LayerMethod *cur;
+
+	SLIST_FOREACH(cur, &methods, methods)
+		if (!strcmp(cur->name, method))
+			break;
+
+	if (!cur) {
+		WARNING_MSG("Layer \"%s\" has no method \"%s\"", name, method);
+		return NULL;
+	}
+	if (!cur->args || strlen(cur->types) > MODULATOR_MAX_ARGS) {
+		WARNING_MSG("Method \"%s\" cannot be modulated", method);
+		return NULL;
+	}
+	if (!cur->stored) {
+		WARNING_MSG("Method \"%s\" must be called before it can be "
+			    "modulated", method);
+		return NULL;
+	}
+	if (index < -1 || index >= (int)strlen(cur->types)) {
+		WARNING_MSG("Invalid argument index %d of method \"%s\"",
+			    index, method);
+		return NULL;
+	}
+
+	return cur;
+}
+
+/*
+ * Replaces the modulator of the same method argument
+ */
+void
+Layer::add_modulator(Modulator *mod)
+{
+	Modulator *cur, *last = NULL;
+
+	TAILQ_FOREACH(cur, &modulators, modulators) {
+		if (cur->method != mod->method)
+			continue;
+
+		if (cur->index == mod->index) {
+			TAILQ_INSERT_AFTER(&modulators, cur, mod, modulators);
+			TAILQ_REMOVE(&modulators, cur, modulators);
+			delete cur;
+			return;
+		}
+		last = cur;
+	}
+
+	if (last)
+		TAILQ_INSERT_AFTER(&modulators, last, mod, modulators);
+	else
+		TAILQ_INSERT_TAIL(&modulators, mod, modulators);
+}
+
+void
+Layer::lfo(const char *method, int index, const char *shape,
+	   float frequency, float center, float depth, float phase)
+{
+	OSCServer::LayerMethod *m = find_method(method, index);
+	ModulatorLFO::Shape s;
+
+	if (!m || index < 0)
+		return;
+	if (!ModulatorLFO::parse_shape(shape, s)) {
+		WARNING_MSG("Unknown LFO shape \"%s\"", shape);
+		return;
+	}
+
+	add_modulator(new ModulatorLFO(m, index, s, frequency,
+				       center, depth, phase));
+}
+
+void
+Layer::envelope(const char *method, int index,
+		float attack, float decay, float sustain, float release,
+		float low, float high)
+{
+	OSCServer::LayerMethod *m = find_method(method, index);
+
+	if (!m || index < 0)
+		return;
+
+	add_modulator(new ModulatorEnvelope(m, index, attack, decay,
+					    sustain, release, low, high));
+}
+
+/*
+ * Index -1 refers to all modulated arguments of the method
+ */
+void
+Layer::gate(const char *method, int index, bool on)
+{
+	OSCServer::LayerMethod *m = find_method(method, index);
+	Uint32 ticks = SDL_GetTicks();
+	Modulator *cur;
+
+	if (!m)
+		return;
+
+	TAILQ_FOREACH(cur, &modulators, modulators)
+		if (cur->method == m && (index < 0 || cur->index == index))
+			cur->gate(on, ticks);
+}
+
+/*
+ * Removes modulators and restores the arguments last sent by clients.
+ * Index -1 refers to all modulated arguments of the method.
+ */
+void
+Layer::unmodulate(const char *method, int index)
+{
+	OSCServer::LayerMethod *m = find_method(method, index);
+	Modulator *cur, *next;
+	lo_arg *argv[MODULATOR_MAX_ARGS];
+	bool removed = false;
+
+	if (!m)
+		return;
+
+	for (cur = TAILQ_FIRST(&modulators); cur; cur = next) {
+		next = TAILQ_NEXT(cur, modulators);
+
+		if (cur->method == m && (index < 0 || cur->index == index)) {
+			TAILQ_REMOVE(&modulators, cur, modulators);
+			delete cur;
+			removed = true;
+		}
+	}
+
+	if (!removed)
+		return;
+
+	for (int i = 0; m->types[i]; i++)
+		argv[i] = m->args + i;
+	m->method_cb(this, argv);
+}
+
+/*
+ * Calls every modulated method with the arguments last sent by
+ * clients, replacing the modulated ones.
+ * Methods are only called if a modulated argument has changed or
+ * a client has called the method, overriding the modulated ones.
+ */
+void
+Layer::modulate(Uint32 ticks)
+{
+	Modulator *mod = TAILQ_FIRST(&modulators);
+
+	while (mod) {
+		OSCServer::LayerMethod *method = mod->method;
+		lo_arg args[MODULATOR_MAX_ARGS];
+		lo_arg *argv[MODULATOR_MAX_ARGS];
+		bool updated = method->called;
+
+		for (int i = 0; method->types[i]; i++) {
+			args[i] = method->args[i];
+			argv[i] = args + i;
+		}
+		method->called = false;
+
+		for (; mod && mod->method == method;
+		     mod = TAILQ_NEXT(mod, modulators)) {
+			float value = mod->value(ticks);
+			lo_arg *arg = args + mod->index;
+
+			if (method->types[mod->index] == 'i')
+				arg->i = (int32_t)lroundf(value);
+			else
+				arg->f = value;
+
+			if (mod->applied &&
+			    !memcmp(arg, &mod->output, sizeof(mod->output)))
+				continue;
+			mod->output = *arg;
+			mod->applied = true;
+			updated = true;
+		}
+
+		if (updated) {
+			method->method_cb(this, argv);
+			changed = true;
+		}
+	}
 }
 
 Layer::~Layer()
 {
+	while (!TAILQ_EMPTY(&modulators)) {
+		Modulator *mod = TAILQ_FIRST(&modulators);
+
+		TAILQ_REMOVE(&modulators, mod, modulators);
+		delete mod;
+	}
+
+	unregister_method(unmodulate_osc_id);
+	unregister_method(gate_osc_id);
+	unregister_method(envelope_osc_id);
+	unregister_method(lfo_osc_id);
+	unregister_method(alpha_to_osc_id);
+	unregister_method(geo_to_osc_id);
 	unregister_method(alpha_osc_id);
 	unregister_method(geo_osc_id);
 
+	osc_server.del_method(move_hnd);
+	name_index_remove(this);
+
 	free(name);
 }
 
+static int
+move_handler(const char *path __attribute__((unused)),
+	     const char *types __attribute__((unused)),
+	     lo_arg **argv, int argc __attribute__((unused)),
+	     void *data __attribute__((unused)),
+	     void *user_data)
+{
+	Layer *layer = (Layer *)user_data;
+
+	if (!layer->list) {
+		WARNING_MSG("Cannot move unlinked layer \"%s\"", layer->name);
+		return 0;
+	}
+
+	layer->list->move(layer, argv[0]->i);
+	return 0;
+}
+
+/*
+ * Order statistics: every layer knows the size of its subtree,
+ * which is maintained by the tree's rotations through RB_AUGMENT()
+ */
+static inline int
+subtree_size(Layer *layer)
+{
+	return layer ? layer->subtree_size : 0;
+}
+
+static inline void
+update_size(Layer *layer)
+{
+	layer->subtree_size = subtree_size(RB_LEFT(layer, layers)) +
+			      subtree_size(RB_RIGHT(layer, layers)) + 1;
+}
+
+/* position of a layer in its tree */
+static int
+layer_rank(Layer *layer)
+{
+	int rank = subtree_size(RB_LEFT(layer, layers));
+
+	for (Layer *parent = RB_PARENT(layer, layers); parent;
+	     layer = parent, parent = RB_PARENT(parent, layers))
+		if (layer == RB_RIGHT(parent, layers))
+			rank += subtree_size(RB_LEFT(parent, layers)) + 1;
+
+	return rank;
+}
+
+/*
+ * Layers are inserted by position (see tree_insert()), this only
+ * orders layers of the same tree consistently
+ */
+static int
+layer_cmp(Layer *l1, Layer *l2)
+{
+	return layer_rank(l1) - layer_rank(l2);
+}
+
+#undef RB_AUGMENT
+#define RB_AUGMENT(X) update_size(X)
+
+RB_GENERATE(layer_tree, Layer, layers, layer_cmp);
+
+/*
+ * Links layer as the pos-th layer (pos <= number of layers)
+ */
+static void
+tree_insert(struct layer_tree *head, int pos, Layer *layer)
+{
+	Layer *parent = NULL, *cur = RB_ROOT(head);
+	bool left = true;
+
+	while (cur) {
+		int left_size = subtree_size(RB_LEFT(cur, layers));
+
+		parent = cur;
+		left = pos <= left_size;
+		if (left) {
+			cur = RB_LEFT(cur, layers);
+		} else {
+			pos -= left_size + 1;
+			cur = RB_RIGHT(cur, layers);
+		}
+	}
+
+	RB_SET(layer, parent, layers);
+	layer->subtree_size = 1;
+	if (!parent)
+		RB_ROOT(head) = layer;
+	else if (left)
+		RB_LEFT(parent, layers) = layer;
+	else
+		RB_RIGHT(parent, layers) = layer;
+
+	for (cur = parent; cur; cur = RB_PARENT(cur, layers))
+		cur->subtree_size++;
+
+	layer_tree_RB_INSERT_COLOR(head, layer);
+}
+
+/*
+ * RB_REMOVE() only updates the sizes of some of the ancestors,
+ * so all of them are updated beforehand
+ */
+static void
+tree_remove(struct layer_tree *head, Layer *layer)
+{
+	for (Layer *cur = RB_PARENT(layer, layers); cur;
+	     cur = RB_PARENT(cur, layers))
+		cur->subtree_size--;
+
+	RB_REMOVE(layer_tree, head, layer);
+}
+
+/*
+ * Inserts layer at position pos or at the top if pos is negative
+ * or exceeds the number of layers
+ */
 void
 LayerList::insert(int pos, Layer *layer)
 {
-	Layer *cur, *prev = NULL;
+	int count;
 
 	lock();
 
-	LIST_FOREACH(cur, &head, layers) {
-		if (!pos--)
-			break;
-		prev = cur;
-	}
+	count = subtree_size(RB_ROOT(&head));
+	tree_insert(&head, pos < 0 || pos > count ? count : pos, layer);
+	layer->list = this;
+	rebuild();
 
-	if (prev)
-		LIST_INSERT_AFTER(prev, layer, layers);
-	else
-		LIST_INSERT_HEAD(&head, layer, layers);
+	unlock();
+}
+
+void
+LayerList::drop_flat()
+{
+	SDL_FREESURFACE_SAFE(flat);
+	flat_count = 0;
+}
+
+/*
+ * Reorders a layer without re-creating it
+ */
+void
+LayerList::move(Layer *layer, int pos)
+{
+	int from, count;
+
+	lock();
+
+	from = layer_rank(layer);
+	tree_remove(&head, layer);
+
+	count = subtree_size(RB_ROOT(&head));
+	if (pos < 0 || pos > count)
+		pos = count;
+	tree_insert(&head, pos, layer);
+
+	if (from < flat_count || pos < flat_count)
+		drop_flat();
+	rebuild();
 
 	unlock();
 }
 
+/*
+ * Unlinks a layer without deleting it (e.g. to move it into a group)
+ */
 void
-LayerList::delete_layer(Layer *layer)
+LayerList::remove(Layer *layer)
 {
 	lock();
-	LIST_REMOVE(layer, layers);
+
+	/*
+	 * Removed layers must not remain in the flattened composite.
+	 * Inserted layers are not static yet, so they drop it anyway.
+	 */
+	if (layer_rank(layer) < flat_count)
+		drop_flat();
+
+	tree_remove(&head, layer);
+	layer->list = NULL;
+	rebuild();
+
 	unlock();
+}
+
+void
+LayerList::delete_layer(Layer *layer)
+{
+	remove(layer);
 
 	/* layer is guaranteed not to be rendered */
 	delete layer;
 }
 
+/*
+ * Rebuilds the render array in drawing order.
+ * Called on every structural change, so draw() never sees removed
+ * layers. Culling data is conservative until refreshed by advance().
+ */
+void
+LayerList::rebuild()
+{
+	Layer *cur;
+
+	num_render = subtree_size(RB_ROOT(&head));
+	if (num_render > max_render) {
+		max_render = num_render;
+		render_layers = (Layer **)
+			realloc(render_layers, max_render*sizeof(Layer *));
+		render_bounds = (SDL_Rect *)
+			realloc(render_bounds, max_render*sizeof(SDL_Rect));
+		render_opaque = (SDL_Rect *)
+			realloc(render_opaque, max_render*sizeof(SDL_Rect));
+		render_alpha = (Uint8 *)
+			realloc(render_alpha, max_render*sizeof(Uint8));
+	}
+
+	num_render = 0;
+	RB_FOREACH(cur, layer_tree, &head) {
+		render_layers[num_render] = cur;
+		render_bounds[num_render].w = 0;
+		render_opaque[num_render].w = 0;
+		render_alpha[num_render] = SDL_ALPHA_OPAQUE;
+		num_render++;
+	}
+	modified = true;
+}
+
+/*
+ * Updates the culling data of a layer, which must be locked
+ */
+void
+LayerList::refresh(int i)
+{
+	Layer *layer = render_layers[i];
+
+	render_bounds[i] = layer->geo_cur;
+	render_alpha[i] = (Uint8)ceilf(layer->alpha_cur*SDL_ALPHA_OPAQUE);
+	if (!render_alpha[i] || !layer->opaque(render_opaque[i]))
+		render_opaque[i].w = 0;
+}
+
+inline bool
+LayerList::culled(int i, SDL_Surface *target)
+{
+	SDL_Rect *bounds = render_bounds + i;
+
+	if (render_alpha[i] == SDL_ALPHA_TRANSPARENT)
+		return true;
+
+	/* default geometries usually depend on the layer's content */
+	if (!bounds->w || !bounds->h)
+		return false;
+
+	return bounds->x >= target->w || bounds->y >= target->h ||
+	       bounds->x + bounds->w <= 0 || bounds->y + bounds->h <= 0;
+}
+
+/*
+ * Advances all layers before anything is drawn, so the bottom run of
+ * static layers is known before drawing.
+ * Groups cache the composite of their children themselves,
+ * so their lists are not flattened.
+ * Returns whether anything in the list has changed.
+ */
+bool
+LayerList::advance(Uint32 ticks)
+{
+	bool in_run = config_flatten_frames > 0 && !owner;
+	bool rebuilt, ret;
+
+	lock();
+
+	rebuilt = ret = modified;
+	modified = false;
+	static_run = 0;
+
+	for (int i = 0; i < num_render; i++) {
+		Layer *cur = render_layers[i];
+		bool animated;
+
+		cur->Mutex::lock();
+		cur->animate(ticks);
+		animated = cur->animated();
+		if (cur->changed || animated || rebuilt)
+			refresh(i);
+		if (cur->changed || animated) {
+			cur->static_frames = 0;
+			ret = true;
+		} else if (cur->static_frames < config_flatten_frames) {
+			cur->static_frames++;
+		}
+		cur->changed = false;
+		cur->Mutex::unlock();
+
+		if (in_run && cur->static_frames >= config_flatten_frames)
+			static_run++;
+		else
+			in_run = false;
+	}
+
+	unlock();
+
+	return ret;
+}
+
+/*
+ * Drawing starts at the topmost layer covering the entire target
+ * or the end of the static bottom run, which is replaced by its cached
+ * composite. Transparent and off-target layers are skipped.
+ * The composite is captured from the target after drawing the run
+ * and dropped as soon as one of its layers changes.
+ * The target is cleared to black unless clear is false.
+ */
 void
-LayerList::render(SDL_Surface *target)
+LayerList::draw(SDL_Surface *target, bool clear)
 {
-	SDL_FillRect(target, NULL, SDL_MapRGB(target->format, 0, 0, 0));
+	int start = 0;
 
 	lock();
 
-	Layer *cur;
-	LIST_FOREACH(cur, &head, layers) {
-		cur->lock();
-		cur->frame(target);
-		cur->unlock();
+	if (flat_count != static_run)
+		drop_flat();
+
+	for (int i = num_render - 1; i >= 0; i--) {
+		SDL_Rect *rect = render_opaque + i;
+
+		if (rect->w && rect->x <= 0 && rect->y <= 0 &&
+		    rect->x + rect->w >= target->w &&
+		    rect->y + rect->h >= target->h) {
+			start = i;
+			break;
+		}
+	}
+
+	if (flat && start < flat_count) {
+		SDL_BlitSurface(flat, NULL, target, NULL);
+		start = flat_count;
+	} else if (!start && clear) {
+		SDL_FillRect(target, NULL, SDL_MapRGB(target->format, 0, 0, 0));
+	}
+
+	for (int i = start; i < num_render; i++) {
+		if (!culled(i, target)) {
+			Layer *cur = render_layers[i];
+
+			cur->Mutex::lock();
+			cur->frame(target);
+			cur->Mutex::unlock();
+		}
+
+		/* layers below an opaque layer are part of the composite */
+		if (!flat && i + 1 == static_run &&
+		    static_run >= FLATTEN_MIN_LAYERS) {
+			flat = SDL_ConvertSurface(target, target->format,
+						  SDL_SWSURFACE);
+			if (flat)
+				flat_count = static_run;
+		}
 	}
 
 	unlock();
@@ -76,10 +918,17 @@ LayerList::render(SDL_Surface *target)
 
 LayerList::~LayerList()
 {
-	while (LIST_FIRST(&head)) {
-		Layer *layer = LIST_FIRST(&head);
+	drop_flat();
+
+	free(render_layers);
+	free(render_bounds);
+	free(render_opaque);
+	free(render_alpha);
+
+	while (!RB_EMPTY(&head)) {
+		Layer *layer = RB_ROOT(&head);
 
-		LIST_REMOVE(layer, layers);
+		tree_remove(&head, layer);
 		delete layer;
 	}
 }
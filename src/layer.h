@@ -3,6 +3,7 @@
 
 #include <string.h>
 #include <bsd/sys/queue.h>
+#include <bsd/sys/tree.h>
 
 #include <SDL.h>
 
@@ -10,9 +11,12 @@
 
 #include "osc_graphics.h"
 #include "osc_server.h"
+#include "modulator.h"
 
 extern OSCServer osc_server;
 
+class LayerList;
+
 class Layer : public Mutex {
 public:
 	/*
@@ -24,13 +28,77 @@ public:
 		const char *types;
 	};
 
-	LIST_ENTRY(Layer) layers;
+	/*
+	 * Layers are ordered by position in a red-black tree,
+	 * augmented with subtree sizes (see LayerList)
+	 */
+	RB_ENTRY(Layer) layers;
+	int subtree_size;
+	LayerList *list;	/* containing list */
 
 	char *name;
+	Layer *name_next;	/* in the name index */
+
+	/*
+	 * Looks up any layer (also in groups) by name
+	 */
+	static Layer *find(const char *name);
+
+	/* registered methods, maintained by OSCServer */
+	SLIST_HEAD(methods_head, OSCServer::LayerMethod) methods;
+
+	/*
+	 * Last geometry and opacity set via the default methods,
+	 * tweens start from these values
+	 */
+	SDL_Rect geo_cur;
+	float alpha_cur;
+
+	/*
+	 * Anything locking a layer may change it, so it is marked as
+	 * changed. The render loop uses Mutex::lock() instead.
+	 */
+	inline void
+	lock()
+	{
+		Mutex::lock();
+		changed = true;
+	}
+
+	bool changed;		/* since the last frame */
+	int static_frames;	/* number of frames without changes */
+
+	/*
+	 * Layers that change without being locked (e.g. playing videos)
+	 * must return true.
+	 * Called once per frame by the render loop, even for layers that
+	 * are not drawn, so it may also do per-frame housekeeping.
+	 */
+	virtual bool animated() { return false; }
+
+	/*
+	 * Area the layer covers opaquely, used to skip the layers
+	 * below. Queried whenever the layer has changed.
+	 */
+	virtual bool
+	opaque(SDL_Rect &rect __attribute__((unused)))
+	{
+		return false;
+	}
 
 	Layer(const char *name);
 	virtual ~Layer();
 
+	/*
+	 * Geometry and opacity the layer was constructed with
+	 */
+	void defaults(SDL_Rect geo, float opacity);
+
+	/*
+	 * Advances running tweens and modulators, called before every frame
+	 */
+	void animate(Uint32 ticks);
+
 	/*
 	 * Frame render method
 	 */
@@ -49,13 +117,79 @@ protected:
 		osc_server.unregister_method(hnd);
 	}
 
+	/*
+	 * Records the arguments (ints and doubles) of a numeric method
+	 * as if it had been called, for state set otherwise (e.g. by
+	 * constructors). Only recorded methods can be modulated, since
+	 * modulated calls pass the recorded unmodulated arguments.
+	 */
+	void store_method(OSCServer::MethodHandlerId *hnd, ...);
+
 	/*
 	 * Default methods
 	 */
 	virtual void geo(SDL_Rect geo) = 0;
 	virtual void alpha(float opacity) = 0;
 
+	/*
+	 * Resolves default (0) dimensions of a geometry to the ones the
+	 * layer would be drawn with, so tweens interpolate between
+	 * visible geometries. By default, they are the screen's.
+	 */
+	virtual SDL_Rect resolve_geo(SDL_Rect geo);
+	/*
+	 * resolve_geo() of layers covering the whole screen if their
+	 * geometry is null, using other dimensions as-is
+	 */
+	static SDL_Rect resolve_null_geo(SDL_Rect geo);
+
 private:
+	/*
+	 * Server-side interpolation of the default parameters,
+	 * so clients do not have to stream them
+	 */
+	enum Easing {
+		EASING_LINEAR = 0,
+		EASING_IN,
+		EASING_OUT,
+		EASING_IN_OUT
+	};
+	struct Tween {
+		bool	active;
+		Uint32	start;		/* ticks */
+		Uint32	duration;	/* milliseconds */
+		Easing	easing;
+	};
+	static Easing parse_easing(const char *name);
+	static float ease(Tween &tween, Uint32 ticks);
+	static void start_tween(Tween &tween, float duration, const char *easing);
+
+	Tween geo_tween;
+	SDL_Rect geo_from, geo_to;	/* resolved */
+	SDL_Rect geo_end;		/* as requested */
+
+	Tween alpha_tween;
+	float alpha_from, alpha_to;
+
+	void store_geo(SDL_Rect geo);
+	void store_alpha(float opacity);
+
+	/*
+	 * Modulators of the same method are kept adjacent,
+	 * so every method is called at most once per frame
+	 */
+	TAILQ_HEAD(modulators_head, Modulator) modulators;
+
+	OSCServer::LayerMethod *find_method(const char *method, int index);
+	void add_modulator(Modulator *mod);
+	void modulate(Uint32 ticks);
+
+	/*
+	 * Not a layer method, since it locks the containing list,
+	 * which must not be done while the layer is locked
+	 */
+	OSCServer::MethodHandlerId *move_hnd;
+
 	/*
 	 * OSC handler methods
 	 */
@@ -67,29 +201,158 @@ private:
 			(Sint16)argv[0]->i, (Sint16)argv[1]->i,
 			(Uint16)argv[2]->i, (Uint16)argv[3]->i
 		};
+		obj->geo_tween.active = false;
+		obj->geo_cur = geo;
 		obj->geo(geo);
 	}
 	OSCServer::MethodHandlerId *alpha_osc_id;
 	static void
 	alpha_osc(Layer *obj, lo_arg **argv)
 	{
+		obj->alpha_tween.active = false;
+		obj->alpha_cur = argv[0]->f;
 		obj->alpha(argv[0]->f);
 	}
+
+	void tween_geo(SDL_Rect geo, float duration, const char *easing);
+	OSCServer::MethodHandlerId *geo_to_osc_id;
+	static void
+	geo_to_osc(Layer *obj, lo_arg **argv)
+	{
+		SDL_Rect geo = {
+			(Sint16)argv[0]->i, (Sint16)argv[1]->i,
+			(Uint16)argv[2]->i, (Uint16)argv[3]->i
+		};
+		obj->tween_geo(geo, argv[4]->f, &argv[5]->s);
+	}
+	void tween_alpha(float opacity, float duration, const char *easing);
+	OSCServer::MethodHandlerId *alpha_to_osc_id;
+	static void
+	alpha_to_osc(Layer *obj, lo_arg **argv)
+	{
+		obj->tween_alpha(argv[0]->f, argv[1]->f, &argv[2]->s);
+	}
+
+	void lfo(const char *method, int index, const char *shape,
+		 float frequency, float center, float depth, float phase);
+	OSCServer::MethodHandlerId *lfo_osc_id;
+	static void
+	lfo_osc(Layer *obj, lo_arg **argv)
+	{
+		obj->lfo(&argv[0]->s, argv[1]->i, &argv[2]->s,
+			 argv[3]->f, argv[4]->f, argv[5]->f, argv[6]->f);
+	}
+
+	void envelope(const char *method, int index,
+		      float attack, float decay, float sustain, float release,
+		      float low, float high);
+	OSCServer::MethodHandlerId *envelope_osc_id;
+	static void
+	envelope_osc(Layer *obj, lo_arg **argv)
+	{
+		obj->envelope(&argv[0]->s, argv[1]->i,
+			      argv[2]->f, argv[3]->f, argv[4]->f, argv[5]->f,
+			      argv[6]->f, argv[7]->f);
+	}
+
+	void gate(const char *method, int index, bool on);
+	OSCServer::MethodHandlerId *gate_osc_id;
+	static void
+	gate_osc(Layer *obj, lo_arg **argv)
+	{
+		obj->gate(&argv[0]->s, argv[1]->i, argv[2]->i);
+	}
+
+	void unmodulate(const char *method, int index);
+	OSCServer::MethodHandlerId *unmodulate_osc_id;
+	static void
+	unmodulate_osc(Layer *obj, lo_arg **argv)
+	{
+		obj->unmodulate(&argv[0]->s, argv[1]->i);
+	}
 };
 
+RB_HEAD(layer_tree, Layer);
+RB_PROTOTYPE(layer_tree, Layer, layers, layer_cmp);
+
+/*
+ * Layers in drawing order (bottom first).
+ * Positional inserts, moves and removals are O(log n).
+ */
 class LayerList : Mutex {
-	LIST_HEAD(layers_head, Layer) head;
+	struct layer_tree head;
+
+	bool modified;		/* layers inserted, moved or removed */
+
+	/*
+	 * Render array: layers in drawing order, rebuilt on structural
+	 * changes.
+	 * Data needed for culling is kept in separate arrays and refreshed
+	 * when a layer changes, so that draw() does not have to lock and
+	 * call layers that draw nothing.
+	 */
+	int num_render;
+	int max_render;			/* allocated */
+	Layer **render_layers;
+	SDL_Rect *render_bounds;	/* geometry, w or h 0 if unknown */
+	SDL_Rect *render_opaque;	/* opaque area, w 0 if none */
+	Uint8 *render_alpha;
+
+	void rebuild();
+	void refresh(int i);
+	bool culled(int i, SDL_Surface *target);
+
+	/*
+	 * Composite of the bottom layers that have not changed for
+	 * config_flatten_frames frames, including the background
+	 */
+	SDL_Surface *flat;
+	int flat_count;		/* number of layers in flat */
+	int static_run;		/* static bottom layers (see advance()) */
+
+	void drop_flat();
 
 public:
-	LayerList() : Mutex()
+	Layer *owner;		/* group or NULL */
+
+	LayerList(Layer *_owner = NULL) : Mutex(), modified(false),
+					  num_render(0), max_render(0),
+					  render_layers(NULL),
+					  render_bounds(NULL),
+					  render_opaque(NULL),
+					  render_alpha(NULL),
+					  flat(NULL), flat_count(0),
+					  static_run(0), owner(_owner)
 	{
-		LIST_INIT(&head);
+		RB_INIT(&head);
 	}
 	~LayerList();
 
+	inline Layer *
+	first()
+	{
+		return RB_MIN(layer_tree, &head);
+	}
+	static inline Layer *
+	next(Layer *layer)
+	{
+		return RB_NEXT(layer_tree, NULL, layer);
+	}
+
 	void insert(int pos, Layer *layer);
+	void move(Layer *layer, int pos);
+	void remove(Layer *layer);
 	void delete_layer(Layer *layer);
-	void render(SDL_Surface *target);
+
+	bool advance(Uint32 ticks);
+	void draw(SDL_Surface *target, bool clear = true);
+
+	inline void
+	render(SDL_Surface *target)
+	{
+		advance(SDL_GetTicks());
+		draw(target);
+	}
 };
 
 #endif
\ No newline at end of file
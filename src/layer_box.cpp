@@ -21,6 +21,8 @@ LayerBox::LayerBox(const char *name, SDL_Rect geo, float opacity,
 	LayerBox::geo(geo);
 	LayerBox::color(color);
 	LayerBox::alpha(opacity);
+
+	store_method(color_osc_id, color.r, color.g, color.b);
 }
 
 void
@@ -32,6 +34,15 @@ LayerBox::geo(SDL_Rect geo)
 	y2 = geo.y + geo.h;
 }
 
+/*
+ * Boxes have no default dimensions
+ */
+SDL_Rect
+LayerBox::resolve_geo(SDL_Rect geo)
+{
+	return geo;
+}
+
 void
 LayerBox::alpha(float opacity)
 {
@@ -45,6 +56,20 @@ LayerBox::frame(SDL_Surface *target)
 		r, g, b, a);
 }
 
+bool
+LayerBox::opaque(SDL_Rect &rect)
+{
+	if (a != SDL_ALPHA_OPAQUE)
+		return false;
+
+	/* like frame(), but the target is assumed to be the screen */
+	rect.x = x1;
+	rect.y = y1;
+	rect.w = (x2 ? : screen->w) - x1;
+	rect.h = (y2 ? : screen->h) - y1;
+	return true;
+}
+
 LayerBox::~LayerBox()
 {
 	unregister_method(color_osc_id);
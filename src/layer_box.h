@@ -28,9 +28,11 @@ public:
 	~LayerBox();
 
 	void frame(SDL_Surface *target);
+	bool opaque(SDL_Rect &rect);
 
 private:
 	void geo(SDL_Rect geo);
+	SDL_Rect resolve_geo(SDL_Rect geo);
 	void alpha(float opacity);
 
 	inline void
@@ -0,0 +1,530 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <SDL.h>
+#include <SDL_thread.h>
+#include <SDL_image.h>
+#include <SDL_rotozoom.h>
+
+#include "osc_graphics.h"
+#include "image_cache.h"
+#include "surface.h"
+#include "layer_flipbook.h"
+
+/*
+ * Macros
+ */
+#define SDL_IMAGE_ERROR(FMT, ...) \
+	ERROR_MSG(FMT ": %s", ##__VA_ARGS__, IMG_GetError())
+
+/* upper bound when counting the files of a sequence */
+#define FLIPBOOK_MAX_FRAMES	100000
+
+#define DEFAULT_RATE		25.	/* frames per second */
+
+Layer::CtorInfo LayerFlipbook::ctor_info = {"flipbook", "s" /* file */};
+
+LayerFlipbook::LayerFlipbook(const char *name, SDL_Rect geo, float opacity,
+			     const char *file) :
+			    Layer(name),
+			    decoder(NULL), decoder_quit(false),
+			    filev(NULL), is_sheet(false),
+			    cols(1), rows(1), framesv(0),
+			    ratev(DEFAULT_RATE), loopv(true),
+			    start_frame(0), start_ticks(SDL_GetTicks()),
+			    generation(0), prepared(false),
+			    num_frames(0), first_number(0), sheet(NULL),
+			    shown(NULL), shown_index(-1)
+{
+	for (int i = 0; i < FLIPBOOK_RING; i++) {
+		ring[i].index = -1;
+		ring[i].surf = NULL;
+	}
+
+	file_osc_id = register_method("file", "s",
+				      (OSCServer::MethodHandlerCb)file_osc);
+	grid_osc_id = register_method("grid", "ii",
+				      (OSCServer::MethodHandlerCb)grid_osc);
+	frames_osc_id = register_method("frames", "i",
+					(OSCServer::MethodHandlerCb)frames_osc);
+	rate_osc_id = register_method("rate", "f",
+				      (OSCServer::MethodHandlerCb)rate_osc);
+	frame_osc_id = register_method("frame", "i",
+				       (OSCServer::MethodHandlerCb)frame_osc);
+	loop_osc_id = register_method("loop", "i",
+				      (OSCServer::MethodHandlerCb)loop_osc);
+
+	LayerFlipbook::alpha(opacity);
+	LayerFlipbook::geo(geo);
+	if (file && *file)
+		LayerFlipbook::file(file);
+
+	store_method(grid_osc_id, cols, rows);
+	store_method(frames_osc_id, framesv);
+	store_method(rate_osc_id, ratev);
+	store_method(loop_osc_id, loopv);
+
+	decoder = SDL_CreateThread(decoder_main, this);
+	if (!decoder)
+		SDL_ERROR("SDL_CreateThread");
+}
+
+void
+LayerFlipbook::geo(SDL_Rect geo)
+{
+	geov = resolve_geo(geo);
+
+	reset();
+}
+
+void
+LayerFlipbook::alpha(float opacity)
+{
+	alphav = opacity;
+}
+
+/*
+ * Only a single integer conversion is allowed, since the pattern
+ * is used as a printf() format string
+ */
+static bool
+pattern_is_valid(const char *pattern)
+{
+	const char *p = strchr(pattern, '%');
+
+	if (!p)
+		return false;
+
+	p++;
+	p += strspn(p, "0123456789");
+	if (*p != 'd')
+		return false;
+
+	return !strchr(p, '%');
+}
+
+void
+LayerFlipbook::file(const char *file)
+{
+	bool sheet = !strchr(file, '%');
+
+	if (!sheet && !pattern_is_valid(file)) {
+		ERROR_MSG("Invalid image sequence pattern \"%s\"", file);
+		return;
+	}
+
+	free(filev);
+	filev = *file ? strdup(file) : NULL;
+	is_sheet = sheet;
+
+	start_frame = 0;
+	start_ticks = SDL_GetTicks();
+
+	reset();
+}
+
+void
+LayerFlipbook::grid(int _cols, int _rows)
+{
+	cols = _cols > 0 ? _cols : 1;
+	rows = _rows > 0 ? _rows : 1;
+
+	if (is_sheet)
+		reset();
+}
+
+void
+LayerFlipbook::frames(int frames)
+{
+	framesv = frames > 0 ? frames : 0;
+
+	reset();
+}
+
+void
+LayerFlipbook::rate(float rate)
+{
+	start_frame = current_frame();
+	start_ticks = SDL_GetTicks();
+	ratev = rate;
+
+	decoder_cond.signal();
+}
+
+void
+LayerFlipbook::seek(int frame)
+{
+	start_frame = frame;
+	start_ticks = SDL_GetTicks();
+
+	decoder_cond.signal();
+}
+
+void
+LayerFlipbook::loop(bool loop)
+{
+	start_frame = current_frame();
+	start_ticks = SDL_GetTicks();
+	loopv = loop;
+
+	decoder_cond.signal();
+}
+
+/*
+ * Frame to display at the current time
+ */
+int
+LayerFlipbook::current_frame()
+{
+	int pos = start_frame +
+		  (int)floorf((SDL_GetTicks() - start_ticks)*ratev/1000.);
+
+	return ahead_frame(pos, 0);
+}
+
+/*
+ * Frame displayed n frames after cur, in playback direction
+ */
+int
+LayerFlipbook::ahead_frame(int cur, int n)
+{
+	int pos = ratev < 0 ? cur - n : cur + n;
+
+	if (num_frames <= 0)
+		return 0;
+
+	if (loopv)
+		return (pos % num_frames + num_frames) % num_frames;
+
+	return pos < 0 ? 0 : pos >= num_frames ? num_frames - 1 : pos;
+}
+
+/*
+ * Invalidates decoded frames (after source or geometry changes).
+ * The last frame displayed is kept until a new one is available.
+ */
+void
+LayerFlipbook::reset()
+{
+	generation++;
+	prepared = false;
+	num_frames = 0;
+	shown_index = -1;
+
+	for (int i = 0; i < FLIPBOOK_RING; i++) {
+		ring[i].index = -1;
+		SDL_FREESURFACE_SAFE(ring[i].surf);
+	}
+	if (sheet) {
+		image_cache.release(sheet);
+		sheet = NULL;
+	}
+
+	decoder_cond.signal();
+}
+
+int
+LayerFlipbook::decoder_main(void *data)
+{
+	((LayerFlipbook *)data)->decode_loop();
+	return 0;
+}
+
+/*
+ * Loads the sprite sheet or counts the files of a sequence.
+ * Must be called with the layer locked, but unlocks it while
+ * accessing files.
+ */
+bool
+LayerFlipbook::prepare()
+{
+	unsigned int gen = generation;
+	char *file = strdup(filev);
+	bool sheet_file = is_sheet;
+	int count = framesv, first = 0;
+	int sheet_w = geov.w*cols, sheet_h = geov.h*rows;
+	SDL_Surface *new_sheet = NULL;
+
+	unlock();
+
+	if (sheet_file) {
+		new_sheet = image_cache.get(file, sheet_w, sheet_h);
+	} else {
+		char path[1024];
+		struct stat st;
+
+		/* sequences may be numbered from 0 or 1 */
+		snprintf(path, sizeof(path), file, 0);
+		if (stat(path, &st))
+			first = 1;
+
+		if (!count) {
+			while (count < FLIPBOOK_MAX_FRAMES) {
+				snprintf(path, sizeof(path), file,
+					 first + count);
+				if (stat(path, &st))
+					break;
+				count++;
+			}
+			if (!count)
+				ERROR_MSG("No images matching \"%s\"", file);
+		}
+	}
+
+	free(file);
+	lock();
+
+	if (gen != generation) {
+		/* superseded */
+		if (new_sheet)
+			image_cache.release(new_sheet);
+		return false;
+	}
+
+	if (sheet_file) {
+		sheet = new_sheet;
+		if (!count && sheet)
+			count = cols*rows;
+	}
+	num_frames = count;
+	first_number = first;
+	prepared = true;
+
+	return true;
+}
+
+SDL_Surface *
+LayerFlipbook::decode_frame(int index, SDL_Rect geo)
+{
+	char path[1024];
+	SDL_Surface *surf;
+
+	snprintf(path, sizeof(path), filev, first_number + index);
+
+	unlock();
+
+	surf = IMG_Load(path);
+	if (surf) {
+		surf = surface_display_format(surf);
+
+		if (surf->w != geo.w || surf->h != geo.h) {
+			SDL_Surface *zoomed;
+
+			zoomed = zoomSurface(surf, (double)geo.w/surf->w,
+					     (double)geo.h/surf->h,
+					     SMOOTHING_ON);
+			SDL_FreeSurface(surf);
+			surf = zoomed ? surface_display_format(zoomed) : NULL;
+		}
+	} else {
+		SDL_IMAGE_ERROR("IMG_Load(\"%s\")", path);
+	}
+
+	lock();
+
+	return surf;
+}
+
+/*
+ * Decoder thread: keeps the ring filled with the next frames in
+ * playback order. Sleeps when the ring is up to date and is woken up
+ * by the render thread when playback advances.
+ */
+void
+LayerFlipbook::decode_loop()
+{
+	lock();
+
+	while (!decoder_quit) {
+		unsigned int gen;
+		int cur, index = -1, slot = -1;
+		SDL_Surface *surf;
+
+		if (!filev || !geov.w || !geov.h) {
+			decoder_cond.wait(*this);
+			continue;
+		}
+		if (!prepared) {
+			prepare();
+			continue;
+		}
+		if (is_sheet || !num_frames) {
+			decoder_cond.wait(*this);
+			continue;
+		}
+
+		cur = current_frame();
+
+		/* next frame in playback order that is not decoded yet */
+		for (int n = 0; n < FLIPBOOK_RING && index < 0; n++) {
+			int i = ahead_frame(cur, n);
+			int s;
+
+			for (s = 0; s < FLIPBOOK_RING && ring[s].index != i; s++);
+			if (s == FLIPBOOK_RING)
+				index = i;
+		}
+
+		/* free slot or slot of a frame outside the decode window */
+		for (int s = 0; s < FLIPBOOK_RING && index >= 0 && slot < 0; s++) {
+			int n;
+
+			if (ring[s].index < 0) {
+				slot = s;
+				break;
+			}
+
+			for (n = 0; n < FLIPBOOK_RING &&
+				    ahead_frame(cur, n) != ring[s].index; n++);
+			if (n == FLIPBOOK_RING)
+				slot = s;
+		}
+
+		if (slot < 0) {
+			decoder_cond.wait(*this);
+			continue;
+		}
+
+		gen = generation;
+		surf = decode_frame(index, geov);
+
+		if (gen != generation) {
+			SDL_FREESURFACE_SAFE(surf);
+			continue;
+		}
+
+		/* frames that failed to decode are skipped when displaying */
+		SDL_FREESURFACE_SAFE(ring[slot].surf);
+		ring[slot].index = index;
+		ring[slot].surf = surf;
+	}
+
+	unlock();
+}
+
+static void
+blit_frame(SDL_Surface *surf, SDL_Rect *src_rect,
+	   SDL_Surface *target, SDL_Rect geo, Uint8 alpha)
+{
+	if (!surf->format->Amask) {
+		if (alpha == SDL_ALPHA_OPAQUE)
+			SDL_SetAlpha(surf, 0, 0);
+		else
+			SDL_SetAlpha(surf, SDL_SRCALPHA, alpha);
+	} else if (alpha < SDL_ALPHA_OPAQUE &&
+		   surface_can_blit_scaled(surf, target)) {
+		/*
+		 * Frames with alpha channel are blended with the layer's
+		 * opacity without intermediate surfaces.
+		 * On non-32-bit displays, their opacity is ignored.
+		 */
+		SDL_Surface *view = surf;
+
+		if (src_rect)
+			view = SDL_CreateRGBSurfaceFrom(
+				(Uint8 *)surf->pixels + src_rect->y*surf->pitch +
+					src_rect->x*surf->format->BytesPerPixel,
+				src_rect->w, src_rect->h,
+				surf->format->BitsPerPixel, surf->pitch,
+				surf->format->Rmask, surf->format->Gmask,
+				surf->format->Bmask, surf->format->Amask);
+		if (view) {
+			surface_blit_scaled(view, target,
+					    geo.x*0x10000, geo.y*0x10000,
+					    view->w, view->h, alpha);
+			if (view != surf)
+				SDL_FreeSurface(view);
+		}
+		return;
+	}
+
+	SDL_BlitSurface(surf, src_rect, target, &geo);
+}
+
+/*
+ * Transparent layers are not drawn, so the shown frame is advanced
+ * here, keeping the decoder busy while the layer is hidden
+ */
+bool
+LayerFlipbook::animated()
+{
+	int cur;
+
+	if (is_sheet)
+		return ratev != 0.;
+
+	cur = prepared ? current_frame() : shown_index;
+	if (cur != shown_index) {
+		for (int s = 0; s < FLIPBOOK_RING; s++) {
+			if (ring[s].index == cur && ring[s].surf) {
+				SDL_FREESURFACE_SAFE(shown);
+				shown = ring[s].surf;
+				shown->refcount++;
+				shown_index = cur;
+				break;
+			}
+		}
+
+		/* the decode window has moved */
+		decoder_cond.signal();
+	}
+
+	return ratev != 0.;
+}
+
+void
+LayerFlipbook::frame(SDL_Surface *target)
+{
+	Uint8 alpha = (Uint8)ceilf(alphav*SDL_ALPHA_OPAQUE);
+	int cur;
+
+	if (is_sheet) {
+		SDL_Rect src_rect;
+
+		if (!sheet || !num_frames)
+			return;
+
+		cur = current_frame();
+		src_rect.x = (Sint16)((cur % cols)*geov.w);
+		src_rect.y = (Sint16)((cur / cols % rows)*geov.h);
+		src_rect.w = geov.w;
+		src_rect.h = geov.h;
+
+		blit_frame(sheet, &src_rect, target, geov, alpha);
+		return;
+	}
+
+	if (shown)
+		blit_frame(shown, NULL, target, geov, alpha);
+}
+
+LayerFlipbook::~LayerFlipbook()
+{
+	unregister_method(file_osc_id);
+	unregister_method(grid_osc_id);
+	unregister_method(frames_osc_id);
+	unregister_method(rate_osc_id);
+	unregister_method(frame_osc_id);
+	unregister_method(loop_osc_id);
+
+	if (decoder) {
+		lock();
+		decoder_quit = true;
+		decoder_cond.signal();
+		unlock();
+
+		SDL_WaitThread(decoder, NULL);
+	}
+
+	reset();
+	SDL_FREESURFACE_SAFE(shown);
+	free(filev);
+}
@@ -0,0 +1,144 @@
+#ifndef __LAYER_FLIPBOOK_H
+#define __LAYER_FLIPBOOK_H
+
+#include <SDL.h>
+#include <SDL_thread.h>
+
+#include <lo/lo.h>
+
+#include "osc_graphics.h"
+#include "osc_server.h"
+#include "layer.h"
+
+/* number of frames decoded ahead */
+#define FLIPBOOK_RING	16
+
+/*
+ * Plays back image sequences (file name patterns like "frames/%04d.png")
+ * or sprite sheets (file names without pattern, divided into a grid).
+ * Sequence frames are decoded ahead by a dedicated thread into a bounded
+ * ring of display format surfaces.
+ */
+class LayerFlipbook : public Layer {
+	SDL_Thread	*decoder;
+	Cond		decoder_cond;
+	bool		decoder_quit;
+
+	/* source */
+	char		*filev;
+	bool		is_sheet;
+	int		cols, rows;	/* sprite sheet grid */
+	int		framesv;	/* number of frames, 0 to count */
+
+	SDL_Rect	geov;
+	float		alphav;
+
+	/* playback */
+	float		ratev;		/* frames per second */
+	bool		loopv;
+	int		start_frame;
+	Uint32		start_ticks;
+
+	/*
+	 * Decoder state, reset whenever the source or geometry changes.
+	 * The generation is incremented at the same time, so frames decoded
+	 * concurrently are discarded.
+	 */
+	unsigned int	generation;
+	bool		prepared;
+	int		num_frames;
+	int		first_number;	/* file number of frame 0 */
+	SDL_Surface	*sheet;		/* scaled sprite sheet (from image cache) */
+
+	struct Frame {
+		int		index;
+		SDL_Surface	*surf;
+	} ring[FLIPBOOK_RING];
+
+	SDL_Surface	*shown;		/* last frame displayed */
+	int		shown_index;
+
+public:
+	LayerFlipbook(const char *name, SDL_Rect geo, float opacity,
+		      const char *file);
+
+	static CtorInfo ctor_info;
+	static Layer *
+	ctor_osc(const char *name, SDL_Rect geo, float opacity, lo_arg **argv)
+	{
+		return new LayerFlipbook(name, geo, opacity, &argv[0]->s);
+	}
+
+	~LayerFlipbook();
+
+	bool animated();
+	void frame(SDL_Surface *target);
+
+private:
+	void geo(SDL_Rect geo);
+	SDL_Rect
+	resolve_geo(SDL_Rect geo)
+	{
+		return resolve_null_geo(geo);
+	}
+	void alpha(float opacity);
+
+	void file(const char *file);
+	OSCServer::MethodHandlerId *file_osc_id;
+	static void
+	file_osc(LayerFlipbook *obj, lo_arg **argv)
+	{
+		obj->file(&argv[0]->s);
+	}
+
+	void grid(int cols, int rows);
+	OSCServer::MethodHandlerId *grid_osc_id;
+	static void
+	grid_osc(LayerFlipbook *obj, lo_arg **argv)
+	{
+		obj->grid(argv[0]->i, argv[1]->i);
+	}
+
+	void frames(int frames);
+	OSCServer::MethodHandlerId *frames_osc_id;
+	static void
+	frames_osc(LayerFlipbook *obj, lo_arg **argv)
+	{
+		obj->frames(argv[0]->i);
+	}
+
+	void rate(float rate);
+	OSCServer::MethodHandlerId *rate_osc_id;
+	static void
+	rate_osc(LayerFlipbook *obj, lo_arg **argv)
+	{
+		obj->rate(argv[0]->f);
+	}
+
+	void seek(int frame);
+	OSCServer::MethodHandlerId *frame_osc_id;
+	static void
+	frame_osc(LayerFlipbook *obj, lo_arg **argv)
+	{
+		obj->seek(argv[0]->i);
+	}
+
+	void loop(bool loop);
+	OSCServer::MethodHandlerId *loop_osc_id;
+	static void
+	loop_osc(LayerFlipbook *obj, lo_arg **argv)
+	{
+		obj->loop(argv[0]->i);
+	}
+
+	int current_frame();
+	int ahead_frame(int cur, int n);
+	void reset();
+
+	static int decoder_main(void *data);
+	void decode_loop();
+	bool prepare();
+	SDL_Surface *decode_frame(int index, SDL_Rect geo);
+};
+
+#endif
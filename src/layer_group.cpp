@@ -0,0 +1,233 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+
+#include <SDL.h>
+
+#include <lo/lo.h>
+
+#include "osc_graphics.h"
+#include "osc_server.h"
+#include "surface.h"
+#include "layer_group.h"
+
+/*
+ * liblo callbacks
+ */
+extern "C" {
+
+static int adopt_handler(const char *path, const char *types,
+			 lo_arg **argv, int argc,
+			 void *data, void *user_data);
+static int release_handler(const char *path, const char *types,
+			   lo_arg **argv, int argc,
+			   void *data, void *user_data);
+
+}
+
+extern LayerList layers;
+
+Layer::CtorInfo LayerGroup::ctor_info = {"group", ""};
+
+LayerGroup::LayerGroup(const char *name, SDL_Rect geo, float opacity) :
+		      Layer(name), children(this),
+			      surf(NULL), white(NULL), redraw(true)
+{
+	osc_server.add_method(&adopt_hnd, "si", adopt_handler, this,
+			      "/layer/%s/adopt", name);
+	osc_server.add_method(&release_hnd, "si", release_handler, this,
+			      "/layer/%s/release", name);
+
+	LayerGroup::geo(geo);
+	LayerGroup::alpha(opacity);
+}
+
+void
+LayerGroup::geo(SDL_Rect geo)
+{
+	geov = geo;
+	if (!geov.w)
+		geov.w = screen->w;
+	if (!geov.h)
+		geov.h = screen->h;
+}
+
+void
+LayerGroup::alpha(float opacity)
+{
+	alphav = opacity;
+}
+
+/*
+ * Moves a top-level layer into the group
+ */
+void
+LayerGroup::adopt(const char *name, int pos)
+{
+	Layer *layer = Layer::find(name);
+
+	if (!layer || layer->list != &::layers) {
+		WARNING_MSG("Cannot adopt unknown or nested layer \"%s\"",
+			    name);
+		return;
+	}
+
+	for (Layer *cur = this; cur; cur = cur->list ? cur->list->owner : NULL) {
+		if (cur == layer) {
+			WARNING_MSG("Group \"%s\" cannot adopt \"%s\"",
+				    this->name, name);
+			return;
+		}
+	}
+
+	::layers.remove(layer);
+	children.insert(pos, layer);
+}
+
+/*
+ * Moves a child back into the top-level layers
+ */
+void
+LayerGroup::release(const char *name, int pos)
+{
+	Layer *layer = Layer::find(name);
+
+	if (!layer || layer->list != &children) {
+		WARNING_MSG("Group \"%s\" has no layer \"%s\"",
+			    this->name, name);
+		return;
+	}
+
+	children.remove(layer);
+	::layers.insert(pos, layer);
+}
+
+static int
+adopt_handler(const char *path __attribute__((unused)),
+	      const char *types __attribute__((unused)),
+	      lo_arg **argv, int argc __attribute__((unused)),
+	      void *data __attribute__((unused)),
+	      void *user_data)
+{
+	((LayerGroup *)user_data)->adopt(&argv[0]->s, argv[1]->i);
+	return 0;
+}
+
+static int
+release_handler(const char *path __attribute__((unused)),
+		const char *types __attribute__((unused)),
+		lo_arg **argv, int argc __attribute__((unused)),
+		void *data __attribute__((unused)),
+		void *user_data)
+{
+	((LayerGroup *)user_data)->release(&argv[0]->s, argv[1]->i);
+	return 0;
+}
+
+/*
+ * Children are advanced along with the group, so the group counts as
+ * changed (e.g. when flattening) whenever one of its children does
+ */
+bool
+LayerGroup::animated()
+{
+	if (children.advance(SDL_GetTicks()))
+		redraw = true;
+
+	return redraw;
+}
+
+/*
+ * On 32-bit targets, the composite is cached with an alpha channel.
+ * Otherwise, a surface in the target's format is used to composite the
+ * children over a copy of the background every frame.
+ */
+bool
+LayerGroup::alloc_surfaces(SDL_Surface *target)
+{
+	if (surf && surf->w == geov.w && surf->h == geov.h)
+		return true;
+
+	SDL_FREESURFACE_SAFE(white);
+	SDL_FREESURFACE_SAFE(surf);
+	redraw = true;
+
+	surf = surface_new_alpha(geov.w, geov.h);
+	if (surf && surface_can_blit_scaled(surf, target)) {
+		white = surface_new_alpha(geov.w, geov.h);
+		if (white)
+			return true;
+	}
+	SDL_FREESURFACE_SAFE(surf);
+
+	surf = SDL_CreateRGBSurface(SDL_SWSURFACE, geov.w, geov.h,
+				    target->format->BitsPerPixel,
+				    target->format->Rmask,
+				    target->format->Gmask,
+				    target->format->Bmask, 0);
+	if (!surf)
+		SDL_ERROR("SDL_CreateRGBSurface");
+
+	return surf != NULL;
+}
+
+/*
+ * The cached composite is recovered from renderings of the children
+ * on black and on white (see surface_unmatte()), so the group blends
+ * with the layers below like its children would
+ */
+void
+LayerGroup::frame(SDL_Surface *target)
+{
+	Uint8 alpha = (Uint8)ceilf(alphav*SDL_ALPHA_OPAQUE);
+	SDL_Rect src_rect = geov;
+	SDL_Rect dst_rect = {geov.x, geov.y};
+
+	if (alpha == SDL_ALPHA_TRANSPARENT || !alloc_surfaces(target))
+		return;
+
+	if (white) {
+		if (redraw) {
+			SDL_FillRect(surf, NULL,
+				     SDL_MapRGBA(surf->format, 0, 0, 0,
+						 SDL_ALPHA_OPAQUE));
+			children.draw(surf, false);
+			SDL_FillRect(white, NULL,
+				     SDL_MapRGBA(white->format, 255, 255, 255,
+						 SDL_ALPHA_OPAQUE));
+			children.draw(white, false);
+			surface_unmatte(surf, white, surf);
+			redraw = false;
+		}
+
+		surface_blit_scaled(surf, target,
+				    geov.x*0x10000, geov.y*0x10000,
+				    surf->w, surf->h, alpha);
+		return;
+	}
+
+	SDL_BlitSurface(target, &src_rect, surf, NULL);
+	children.draw(surf, false);
+	redraw = false;
+
+	if (alpha == SDL_ALPHA_OPAQUE)
+		SDL_SetAlpha(surf, 0, 0);
+	else
+		SDL_SetAlpha(surf, SDL_SRCALPHA, alpha);
+	SDL_BlitSurface(surf, NULL, target, &dst_rect);
+}
+
+LayerGroup::~LayerGroup()
+{
+	osc_server.del_method(release_hnd);
+	osc_server.del_method(adopt_hnd);
+
+	/* children are deleted along with the group */
+	for (Layer *cur = children.first(); cur; cur = LayerList::next(cur))
+		osc_server.del_method("", "/layer/%s/delete", cur->name);
+
+	SDL_FREESURFACE_SAFE(white);
+	SDL_FREESURFACE_SAFE(surf);
+}
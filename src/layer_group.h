@@ -0,0 +1,63 @@
+#ifndef __LAYER_GROUP_H
+#define __LAYER_GROUP_H
+
+#include <SDL.h>
+
+#include <lo/lo.h>
+
+#include "osc_graphics.h"
+#include "osc_server.h"
+#include "layer.h"
+
+/*
+ * Group of layers that can be moved and faded as a whole.
+ * Existing layers are moved into the group ("adopt") and out of it
+ * ("release"). Their geometries are relative to the group.
+ * On 32-bit displays, children are composited into an offscreen
+ * surface with alpha channel that is only recomposited when a child
+ * changes, so static groups cost a single blend per frame.
+ */
+class LayerGroup : public Layer {
+	LayerList	children;
+
+	SDL_Surface	*surf;		/* composite of children */
+	SDL_Surface	*white;		/* children on white, NULL if uncached */
+	bool		redraw;		/* children changed */
+
+	SDL_Rect	geov;
+	float		alphav;
+
+	/*
+	 * Not layer methods, since they lock the layer lists,
+	 * which must not be done while the group is locked
+	 */
+	OSCServer::MethodHandlerId *adopt_hnd;
+	OSCServer::MethodHandlerId *release_hnd;
+
+public:
+	LayerGroup(const char *name, SDL_Rect geo, float opacity);
+
+	static CtorInfo ctor_info;
+	static Layer *
+	ctor_osc(const char *name, SDL_Rect geo, float opacity,
+		 lo_arg **argv __attribute__((unused)))
+	{
+		return new LayerGroup(name, geo, opacity);
+	}
+
+	~LayerGroup();
+
+	bool animated();
+	void frame(SDL_Surface *target);
+
+	void adopt(const char *name, int pos);
+	void release(const char *name, int pos);
+
+private:
+	void geo(SDL_Rect geo);
+	void alpha(float opacity);
+
+	bool alloc_surfaces(SDL_Surface *target);
+};
+
+#endif
@@ -2,134 +2,319 @@
 #include "config.h"
 #endif
 
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include <SDL.h>
-#include <SDL_image.h>
-#include <SDL_rotozoom.h>
 
 #include "osc_graphics.h"
+#include "worker_pool.h"
+#include "image_cache.h"
+#include "surface.h"
 #include "layer_image.h"
 
 Layer::CtorInfo LayerImage::ctor_info = {"image", "s" /* file */};
 
-/*
- * Macros
- */
-#define SDL_IMAGE_ERROR(FMT, ...) \
-	ERROR_MSG(FMT ": %s", ##__VA_ARGS__, IMG_GetError())
+class LayerImage::UpdateJob : public WorkerPool::Job {
+public:
+	UpdateJob(LayerImage *layer) : WorkerPool::Job(layer) {}
+
+	void
+	run()
+	{
+		((LayerImage *)owner)->update();
+	}
+};
 
 LayerImage::LayerImage(const char *name, SDL_Rect geo, float opacity,
 		       const char *file) :
 		      Layer(name),
-		      surf_alpha(NULL), surf_scaled(NULL), surf(NULL)
+		      surf_alpha(NULL), surf(NULL), filev(NULL),
+		      composite_scalev(false),
+		      pending_file(NULL), update_pending(false),
+		      last_visible(SDL_GetTicks()), parked(NULL)
 {
 	file_osc_id = register_method("file", "s",
 				      (OSCServer::MethodHandlerCb)file_osc);
+	composite_scale_osc_id = register_method("composite_scale", "i",
+						 (OSCServer::MethodHandlerCb)composite_scale_osc);
 
 	LayerImage::alpha(opacity);
 	LayerImage::geo(geo);
-	LayerImage::file(file);
+	if (file && *file)
+		LayerImage::file(file);
+
+	store_method(composite_scale_osc_id, composite_scalev);
 }
 
 void
 LayerImage::geo(SDL_Rect geo)
 {
-	if (!geo.x && !geo.y && !geo.w && !geo.h)
-		geov = (SDL_Rect){0, 0, screen->w, screen->h};
-	else
-		geov = geo;
-
-	if (!surf)
-		return;
+	geov = resolve_geo(geo);
 
-	if (surf_scaled &&
-	    surf_scaled->w == geov.w && surf_scaled->h == geov.h)
-		return;
+	if (filev && needs_reload())
+		schedule_update();
+}
 
-	SDL_FREESURFACE_SAFE(surf_alpha);
-	SDL_FREESURFACE_SAFE(surf_scaled);
+static SDL_Surface *
+alpha_surface_new(SDL_Surface *surf, Uint8 alpha)
+{
+	SDL_Surface *surf_alpha;
 
-	if (surf->w != geov.w || surf->h != geov.h) {
-		surf_scaled = zoomSurface(surf,
-					  (double)geov.w/surf->w,
-					  (double)geov.h/surf->h,
-					  SMOOTHING_ON);
-	}
+	surf_alpha = SDL_CreateRGBSurface(surf->flags,
+					  surf->w, surf->h,
+					  surf->format->BitsPerPixel,
+					  surf->format->Rmask,
+					  surf->format->Gmask,
+					  surf->format->Bmask,
+					  surf->format->Amask);
+	rgba_blit_with_alpha(surf, surf_alpha, alpha);
 
-	alpha(alphav);
+	return surf_alpha;
 }
 
 void
 LayerImage::alpha(float opacity)
 {
-	SDL_Surface *use_surf = surf_scaled ? : surf;
 	Uint8 alpha = (Uint8)ceilf(opacity*SDL_ALPHA_OPAQUE);
 
 	alphav = opacity;
 
-	if (!use_surf)
-		return;
-
-	if (!use_surf->format->Amask) {
-		if (alpha == SDL_ALPHA_OPAQUE)
-			SDL_SetAlpha(use_surf, 0, 0);
-		else
-			SDL_SetAlpha(use_surf, SDL_SRCALPHA | SDL_RLEACCEL, alpha);
+	/* cue parked image */
+	if (parked && opacity > 0.)
+		schedule_update();
 
+	/*
+	 * Surfaces are shared with other layers, so the per-surface alpha
+	 * of images without alpha channel is set when blitting
+	 */
+	if (!surf || parked || !surf->format->Amask || composite_scalev)
 		return;
-	}
 
 	if (alpha == SDL_ALPHA_OPAQUE) {
 		SDL_FREESURFACE_SAFE(surf_alpha);
 		return;
 	}
 
-	if (!surf_alpha) {
-		surf_alpha = SDL_CreateRGBSurface(use_surf->flags,
-						  use_surf->w, use_surf->h,
-						  use_surf->format->BitsPerPixel,
-						  use_surf->format->Rmask,
-						  use_surf->format->Gmask,
-						  use_surf->format->Bmask,
-						  use_surf->format->Amask);
-	}
-
-	rgba_blit_with_alpha(use_surf, surf_alpha, alpha);
+	if (surf_alpha)
+		rgba_blit_with_alpha(surf, surf_alpha, alpha);
+	else
+		surf_alpha = alpha_surface_new(surf, alpha);
 }
 
 void
 LayerImage::file(const char *file)
 {
+	free(pending_file);
+	pending_file = strdup(file ? : "");
+
+	schedule_update();
+}
+
+void
+LayerImage::composite_scale(bool enabled)
+{
+	if (enabled && screen->format->BytesPerPixel != 4) {
+		WARNING_MSG("Scaling while compositing requires a 32-bit display");
+		enabled = false;
+	}
+	if (enabled == composite_scalev)
+		return;
+
+	composite_scalev = enabled;
 	SDL_FREESURFACE_SAFE(surf_alpha);
-	SDL_FREESURFACE_SAFE(surf_scaled);
-	SDL_FREESURFACE_SAFE(surf);
 
-	if (!file || !*file)
+	if (filev)
+		schedule_update();
+}
+
+void
+LayerImage::schedule_update()
+{
+	if (update_pending)
 		return;
 
-	surf = IMG_Load(file);
-	if (!surf) {
-		SDL_IMAGE_ERROR("IMG_Load");
-		exit(EXIT_FAILURE);
+	update_pending = true;
+	worker_pool.push(new UpdateJob(this));
+}
+
+/*
+ * Loads pending files and scales the image to the current geometry
+ * (both via the image cache).
+ * Runs in a worker thread and repeats until the surfaces are up to date,
+ * so requests arriving while the job is running are handled as well.
+ * The layer is only locked while inspecting and replacing its surfaces.
+ */
+void
+LayerImage::update()
+{
+	lock();
+
+	for (;;) {
+		SDL_Surface *new_surf = NULL, *new_alpha = NULL;
+		char *new_file;
+		bool rescale;
+		SDL_Rect geo;
+		Uint8 alpha;
+
+		if (pending_file) {
+			new_file = pending_file;
+			pending_file = NULL;
+			rescale = false;
+		} else if (parked && alphav > 0.) {
+			/* cue: parked is not touched by others */
+			ImageCacheImage *cued = parked;
+
+			unlock();
+			new_surf = image_cache.unpark(cued);
+			lock();
+
+			surf = new_surf;
+			parked = NULL;
+			last_visible = SDL_GetTicks();
+			if (surf)
+				LayerImage::alpha(alphav);
+			else if (!pending_file)
+				/* could not be decoded: load again */
+				pending_file = strdup(filev);
+			continue;
+		} else if (filev && needs_reload()) {
+			new_file = strdup(filev);
+			rescale = true;
+		} else {
+			break;
+		}
+
+		geo = geov;
+		/* the original image is scaled while compositing */
+		if (composite_scalev)
+			geo.w = geo.h = 0;
+		alpha = (Uint8)ceilf(alphav*SDL_ALPHA_OPAQUE);
+		unlock();
+
+		if (*new_file)
+			new_surf = image_cache.get(new_file, geo.w, geo.h);
+		if (new_surf && new_surf->format->Amask &&
+		    geo.w && alpha < SDL_ALPHA_OPAQUE)
+			new_alpha = alpha_surface_new(new_surf, alpha);
+
+		lock();
+
+		if (pending_file || (*new_file && !new_surf)) {
+			/*
+			 * superseded or failed:
+			 * keep displaying the old image
+			 */
+			if (!pending_file && rescale)
+				scaled_geo = geo;
+
+			SDL_FREESURFACE_SAFE(new_alpha);
+			if (new_surf)
+				image_cache.release(new_surf);
+			free(new_file);
+			continue;
+		}
+
+		SDL_FREESURFACE_SAFE(surf_alpha);
+		if (parked)
+			image_cache.release(parked);
+		else if (surf)
+			image_cache.release(surf);
+		free(filev);
+
+		surf = new_surf;
+		parked = NULL;
+		surf_alpha = new_alpha;
+		filev = *new_file ? new_file : NULL;
+		if (!filev)
+			free(new_file);
+		scaled_geo = geo;
+
+		/*
+		 * The opacity may have changed in the meantime.
+		 * Geometry changes are handled by the next iteration.
+		 */
+		if (alpha != (Uint8)ceilf(alphav*SDL_ALPHA_OPAQUE))
+			LayerImage::alpha(alphav);
 	}
 
-	geo(geov);
+	update_pending = false;
+	unlock();
+}
+
+/*
+ * Transparent layers are not drawn, so hidden images are parked here
+ */
+bool
+LayerImage::animated()
+{
+	Uint8 alpha = (Uint8)ceilf(alphav*SDL_ALPHA_OPAQUE);
+
+	if (surf && !parked && alpha == SDL_ALPHA_TRANSPARENT &&
+	    config_idle_timeout > 0 &&
+	    SDL_GetTicks() - last_visible >= (Uint32)config_idle_timeout*1000)
+		park();
+
+	return false;
 }
 
 void
 LayerImage::frame(SDL_Surface *target)
 {
-	if (surf)
-		SDL_BlitSurface(surf_alpha ? : surf_scaled ? : surf, NULL,
-				target, &geov);
+	/* SDL_BlitSurface() clips the destination rectangle */
+	SDL_Rect dst_rect = geov;
+	Uint8 alpha = (Uint8)ceilf(alphav*SDL_ALPHA_OPAQUE);
+
+	if (!surf || parked || alpha == SDL_ALPHA_TRANSPARENT)
+		return;
+	last_visible = SDL_GetTicks();
+
+	/*
+	 * Also bridges geometry changes until the image has been
+	 * rescaled in the background
+	 */
+	if ((composite_scalev || surf->w != geov.w || surf->h != geov.h) &&
+	    surface_can_blit_scaled(surf, target)) {
+		surface_blit_scaled(surf, target,
+				    geov.x*0x10000, geov.y*0x10000,
+				    geov.w, geov.h, alpha);
+		return;
+	}
+
+	if (!surf->format->Amask) {
+		if (alpha == SDL_ALPHA_OPAQUE)
+			SDL_SetAlpha(surf, 0, 0);
+		else
+			SDL_SetAlpha(surf, SDL_SRCALPHA, alpha);
+	}
+
+	SDL_BlitSurface(surf_alpha ? : surf, NULL, target, &dst_rect);
+}
+
+void
+LayerImage::park()
+{
+	parked = image_cache.park(surf);
+	if (!parked)
+		return;
+
+	SDL_FREESURFACE_SAFE(surf_alpha);
+	surf = NULL;
 }
 
 LayerImage::~LayerImage()
 {
 	unregister_method(file_osc_id);
+	unregister_method(composite_scale_osc_id);
+
+	worker_pool.cancel(this);
+	free(pending_file);
+	free(filev);
 
 	SDL_FREESURFACE_SAFE(surf_alpha);
-	SDL_FREESURFACE_SAFE(surf_scaled);
-	SDL_FREESURFACE_SAFE(surf);
+	if (parked)
+		image_cache.release(parked);
+	else if (surf)
+		image_cache.release(surf);
 }
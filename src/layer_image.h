@@ -7,16 +7,43 @@
 #include <SDL.h>
 
 #include "osc_graphics.h"
+#include "image_cache.h"
 #include "layer.h"
 
 class LayerImage : public Layer {
 	SDL_Surface	*surf_alpha;	/* with per-surface alpha */
-	SDL_Surface	*surf_scaled;	/* scaled image */
-	SDL_Surface	*surf;		/* original image */
+	SDL_Surface	*surf;		/* scaled image (from image cache) */
 
+	char		*filev;
 	SDL_Rect	geov;
 	float		alphav;
 
+	SDL_Rect	scaled_geo;	/* geometry surf was scaled to */
+
+	/*
+	 * Scale the original image while compositing instead of
+	 * prescaling it, so geometry changes are cheap
+	 */
+	bool		composite_scalev;
+
+	/*
+	 * Images are loaded and scaled by a background job.
+	 * The currently displayed surfaces are only replaced when
+	 * the job has finished.
+	 */
+	class UpdateJob;
+	char		*pending_file;	/* file to load or NULL */
+	bool		update_pending;	/* update job queued or running */
+
+	/*
+	 * Surfaces of layers hidden for longer than the idle timeout
+	 * are parked in the image cache (which may compress them)
+	 * and unparked in the background when the layer becomes
+	 * visible again
+	 */
+	Uint32		last_visible;	/* SDL ticks */
+	ImageCacheImage	*parked;	/* replaces surf while parked */
+
 public:
 	LayerImage(const char *name,
 		   SDL_Rect geo = (SDL_Rect){0, 0, 0, 0},
@@ -32,10 +59,16 @@ public:
 
 	~LayerImage();
 
+	bool animated();
 	void frame(SDL_Surface *target);
 
 private:
 	void geo(SDL_Rect geo);
+	SDL_Rect
+	resolve_geo(SDL_Rect geo)
+	{
+		return resolve_null_geo(geo);
+	}
 	void alpha(float opacity);
 
 	void file(const char *file = NULL);
@@ -45,6 +78,32 @@ private:
 	{
 		obj->file(&argv[0]->s);
 	}
+
+	void composite_scale(bool enabled);
+	OSCServer::MethodHandlerId *composite_scale_osc_id;
+	static void
+	composite_scale_osc(LayerImage *obj, lo_arg **argv)
+	{
+		obj->composite_scale(argv[0]->i);
+	}
+
+	/* parked images are rescaled once they are cued */
+	inline bool
+	needs_reload()
+	{
+		return !parked && !scaled_is_valid();
+	}
+	inline bool
+	scaled_is_valid()
+	{
+		if (composite_scalev)
+			return !scaled_geo.w && !scaled_geo.h;
+
+		return scaled_geo.w == geov.w && scaled_geo.h == geov.h;
+	}
+	void schedule_update();
+	void update();
+	void park();
 };
 
 #endif
@@ -0,0 +1,270 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <SDL.h>
+
+#include "osc_graphics.h"
+#include "worker_pool.h"
+#include "sprite_batch.h"
+#include "layer_particles.h"
+
+/* upper bound for the number of particles */
+#define PARTICLES_MAX	65536
+
+/* upper bound for simulation steps, e.g. after stalls */
+#define MAX_STEP	0.1	/* seconds */
+
+Layer::CtorInfo LayerParticles::ctor_info = {"particles", "s" /* file */};
+
+LayerParticles::LayerParticles(const char *name, SDL_Rect geo, float opacity,
+			       const char *file) :
+			      Layer(name), atlas(this),
+			      emitter_x(0), emitter_y(0),
+			      ratev(100.), lifetimev(2.),
+			      speedv(100.), directionv(90.), spreadv(30.),
+			      gravity_x(0.), gravity_y(0.), dragv(0.),
+			      size_start(1.), size_end(1.),
+			      fade_start(1.), fade_end(0.),
+			      num_particles(0), max_particles(0),
+			      px(NULL), py(NULL), vx(NULL), vy(NULL),
+			      age(NULL), life(NULL), instances(NULL),
+			      emit_fraction(0.), last_ticks(SDL_GetTicks()),
+			      random_state(0x2545F491)
+{
+	file_osc_id = register_method("file", "s",
+				      (OSCServer::MethodHandlerCb)file_osc);
+	emitter_osc_id = register_method("emitter", "ii",
+					 (OSCServer::MethodHandlerCb)emitter_osc);
+	rate_osc_id = register_method("rate", "f",
+				      (OSCServer::MethodHandlerCb)rate_osc);
+	burst_osc_id = register_method("burst", "i",
+				       (OSCServer::MethodHandlerCb)burst_osc);
+	lifetime_osc_id = register_method("lifetime", "f",
+					  (OSCServer::MethodHandlerCb)lifetime_osc);
+	velocity_osc_id = register_method("velocity", "fff",
+					  (OSCServer::MethodHandlerCb)velocity_osc);
+	gravity_osc_id = register_method("gravity", "ff",
+					 (OSCServer::MethodHandlerCb)gravity_osc);
+	drag_osc_id = register_method("drag", "f",
+				      (OSCServer::MethodHandlerCb)drag_osc);
+	size_osc_id = register_method("size", "ff",
+				      (OSCServer::MethodHandlerCb)size_osc);
+	fade_osc_id = register_method("fade", "ff",
+				      (OSCServer::MethodHandlerCb)fade_osc);
+
+	LayerParticles::geo(geo);
+	LayerParticles::alpha(opacity);
+	if (file && *file)
+		LayerParticles::file(file);
+
+	store_method(emitter_osc_id, emitter_x, emitter_y);
+	store_method(rate_osc_id, ratev);
+	store_method(lifetime_osc_id, lifetimev);
+	store_method(velocity_osc_id, speedv, directionv, spreadv);
+	store_method(gravity_osc_id, gravity_x, gravity_y);
+	store_method(drag_osc_id, dragv);
+	store_method(size_osc_id, size_start, size_end);
+	store_method(fade_osc_id, fade_start, fade_end);
+}
+
+void
+LayerParticles::geo(SDL_Rect geo)
+{
+	geov = geo;
+	if (!geov.w)
+		geov.w = screen->w;
+	if (!geov.h)
+		geov.h = screen->h;
+}
+
+void
+LayerParticles::alpha(float opacity)
+{
+	alphav = opacity;
+}
+
+void
+LayerParticles::burst(int count)
+{
+	if (count > 0)
+		spawn(count);
+}
+
+/*
+ * Uniformly distributed random number in [0, 1) (xorshift)
+ */
+float
+LayerParticles::random_unit()
+{
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+
+	return (random_state >> 8)/16777216.;
+}
+
+void
+LayerParticles::spawn(int count)
+{
+	if (num_particles + count > PARTICLES_MAX)
+		count = PARTICLES_MAX - num_particles;
+	if (count <= 0)
+		return;
+
+	if (num_particles + count > max_particles) {
+		int n = max_particles*2;
+
+		if (n < num_particles + count)
+			n = num_particles + count;
+		if (n > PARTICLES_MAX)
+			n = PARTICLES_MAX;
+
+		px = (float *)realloc(px, n*sizeof(float));
+		py = (float *)realloc(py, n*sizeof(float));
+		vx = (float *)realloc(vx, n*sizeof(float));
+		vy = (float *)realloc(vy, n*sizeof(float));
+		age = (float *)realloc(age, n*sizeof(float));
+		life = (float *)realloc(life, n*sizeof(float));
+		instances = (SpriteInstance *)
+			realloc(instances, n*sizeof(SpriteInstance));
+		max_particles = n;
+	}
+
+	for (int i = num_particles; i < num_particles + count; i++) {
+		float angle = (directionv + spreadv*(random_unit() - .5))*
+			      (float)M_PI/180.;
+
+		px[i] = emitter_x;
+		py[i] = emitter_y;
+		/* y grows downwards */
+		vx[i] = speedv*cosf(angle);
+		vy[i] = -speedv*sinf(angle);
+		age[i] = 0.;
+		life[i] = lifetimev;
+	}
+	num_particles += count;
+}
+
+/*
+ * Straight-line loop over separate arrays, so it can be vectorized
+ */
+static void
+integrate(int n, float dt, float dvx, float dvy, float damping,
+	  float *__restrict__ px, float *__restrict__ py,
+	  float *__restrict__ vx, float *__restrict__ vy,
+	  float *__restrict__ age)
+{
+	for (int i = 0; i < n; i++) {
+		vx[i] = (vx[i] + dvx)*damping;
+		vy[i] = (vy[i] + dvy)*damping;
+		px[i] += vx[i]*dt;
+		py[i] += vy[i]*dt;
+		age[i] += dt;
+	}
+}
+
+void
+LayerParticles::simulate(float dt)
+{
+	float damping = 1. - dragv*dt;
+	float emit;
+
+	integrate(num_particles, dt, gravity_x*dt, gravity_y*dt,
+		  damping > 0. ? damping : 0.,
+		  px, py, vx, vy, age);
+
+	/* remove expired particles by moving the last ones into their place */
+	for (int i = 0; i < num_particles;) {
+		if (age[i] < life[i]) {
+			i++;
+			continue;
+		}
+
+		num_particles--;
+		px[i] = px[num_particles];
+		py[i] = py[num_particles];
+		vx[i] = vx[num_particles];
+		vy[i] = vy[num_particles];
+		age[i] = age[num_particles];
+		life[i] = life[num_particles];
+	}
+
+	emit = emit_fraction + ratev*dt;
+	spawn((int)emit);
+	emit_fraction = emit - floorf(emit);
+}
+
+/*
+ * Transparent layers are not drawn, so the simulation is advanced
+ * here, keeping hidden emitters running
+ */
+bool
+LayerParticles::animated()
+{
+	Uint32 ticks = SDL_GetTicks();
+	float dt = (ticks - last_ticks)/1000.;
+
+	last_ticks = ticks;
+	simulate(dt < MAX_STEP ? dt : MAX_STEP);
+
+	return true;
+}
+
+void
+LayerParticles::frame(SDL_Surface *target)
+{
+	float scale_range = size_end - size_start;
+	float fade_range = fade_end - fade_start;
+
+	if (!atlas.num_cells)
+		return;
+
+	for (int i = 0; i < num_particles; i++) {
+		SpriteInstance *inst = instances + i;
+		float t = age[i]/life[i];
+		float scale = size_start + scale_range*t;
+		float alpha = fade_start + fade_range*t;
+
+		inst->x = sprite_coord(px[i]);
+		inst->y = sprite_coord(py[i]);
+		inst->scale = sprite_scale(scale);
+		inst->cell = 0;
+		if (alpha > 1.)
+			alpha = 1.;
+		inst->alpha = alpha > 0. ? (Uint8)(alpha*SDL_ALPHA_OPAQUE) : 0;
+	}
+
+	sprite_batch_draw(target, geov, atlas.cells, atlas.num_cells,
+			  instances, num_particles,
+			  (Uint8)ceilf(alphav*SDL_ALPHA_OPAQUE));
+}
+
+LayerParticles::~LayerParticles()
+{
+	unregister_method(fade_osc_id);
+	unregister_method(size_osc_id);
+	unregister_method(drag_osc_id);
+	unregister_method(gravity_osc_id);
+	unregister_method(velocity_osc_id);
+	unregister_method(lifetime_osc_id);
+	unregister_method(burst_osc_id);
+	unregister_method(rate_osc_id);
+	unregister_method(emitter_osc_id);
+	unregister_method(file_osc_id);
+
+	/* atlas jobs are owned by the layer */
+	worker_pool.cancel(this);
+
+	free(px);
+	free(py);
+	free(vx);
+	free(vy);
+	free(age);
+	free(life);
+	free(instances);
+}
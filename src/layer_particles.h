@@ -0,0 +1,201 @@
+#ifndef __LAYER_PARTICLES_H
+#define __LAYER_PARTICLES_H
+
+#include <SDL.h>
+
+#include <lo/lo.h>
+
+#include "osc_graphics.h"
+#include "osc_server.h"
+#include "sprite_batch.h"
+#include "layer.h"
+
+/*
+ * Particle system simulated in osc-graphics: a single emitter spawns
+ * particles (instances of an image) that move under gravity and drag
+ * and change their size and opacity over their lifetime.
+ * Clients only configure the emitter and forces.
+ * Particle state is kept in separate arrays per attribute (SoA), so the
+ * integration loops can be vectorized by the compiler.
+ */
+class LayerParticles : public Layer {
+	SpriteAtlas	atlas;		/* single cell */
+
+	SDL_Rect	geov;
+	float		alphav;
+
+	/* emitter, relative to the layer's geometry */
+	int		emitter_x, emitter_y;
+	float		ratev;		/* particles per second */
+	float		lifetimev;	/* seconds */
+	float		speedv;		/* pixels per second */
+	float		directionv;	/* degrees, counter-clockwise */
+	float		spreadv;	/* degrees */
+
+	/* forces */
+	float		gravity_x, gravity_y;	/* pixels per second^2 */
+	float		dragv;		/* fraction of velocity lost per second */
+
+	float		size_start, size_end;
+	float		fade_start, fade_end;
+
+	/* particles */
+	int		num_particles;
+	int		max_particles;	/* allocated */
+	float		*px, *py;
+	float		*vx, *vy;
+	float		*age, *life;	/* seconds */
+	SpriteInstance	*instances;
+
+	float		emit_fraction;	/* of the next particle */
+	Uint32		last_ticks;
+	Uint32		random_state;
+
+public:
+	LayerParticles(const char *name, SDL_Rect geo, float opacity,
+		       const char *file);
+
+	static CtorInfo ctor_info;
+	static Layer *
+	ctor_osc(const char *name, SDL_Rect geo, float opacity, lo_arg **argv)
+	{
+		return new LayerParticles(name, geo, opacity, &argv[0]->s);
+	}
+
+	~LayerParticles();
+
+	bool animated();
+	void frame(SDL_Surface *target);
+
+private:
+	void geo(SDL_Rect geo);
+	void alpha(float opacity);
+
+	inline void
+	file(const char *file)
+	{
+		atlas.file(file);
+	}
+	OSCServer::MethodHandlerId *file_osc_id;
+	static void
+	file_osc(LayerParticles *obj, lo_arg **argv)
+	{
+		obj->file(&argv[0]->s);
+	}
+
+	inline void
+	emitter(int x, int y)
+	{
+		emitter_x = x;
+		emitter_y = y;
+	}
+	OSCServer::MethodHandlerId *emitter_osc_id;
+	static void
+	emitter_osc(LayerParticles *obj, lo_arg **argv)
+	{
+		obj->emitter(argv[0]->i, argv[1]->i);
+	}
+
+	inline void
+	rate(float rate)
+	{
+		ratev = rate > 0. ? rate : 0.;
+	}
+	OSCServer::MethodHandlerId *rate_osc_id;
+	static void
+	rate_osc(LayerParticles *obj, lo_arg **argv)
+	{
+		obj->rate(argv[0]->f);
+	}
+
+	void burst(int count);
+	OSCServer::MethodHandlerId *burst_osc_id;
+	static void
+	burst_osc(LayerParticles *obj, lo_arg **argv)
+	{
+		obj->burst(argv[0]->i);
+	}
+
+	inline void
+	lifetime(float lifetime)
+	{
+		lifetimev = lifetime;
+	}
+	OSCServer::MethodHandlerId *lifetime_osc_id;
+	static void
+	lifetime_osc(LayerParticles *obj, lo_arg **argv)
+	{
+		obj->lifetime(argv[0]->f);
+	}
+
+	inline void
+	velocity(float speed, float direction, float spread)
+	{
+		speedv = speed;
+		directionv = direction;
+		spreadv = spread;
+	}
+	OSCServer::MethodHandlerId *velocity_osc_id;
+	static void
+	velocity_osc(LayerParticles *obj, lo_arg **argv)
+	{
+		obj->velocity(argv[0]->f, argv[1]->f, argv[2]->f);
+	}
+
+	inline void
+	gravity(float x, float y)
+	{
+		gravity_x = x;
+		gravity_y = y;
+	}
+	OSCServer::MethodHandlerId *gravity_osc_id;
+	static void
+	gravity_osc(LayerParticles *obj, lo_arg **argv)
+	{
+		obj->gravity(argv[0]->f, argv[1]->f);
+	}
+
+	inline void
+	drag(float drag)
+	{
+		dragv = drag;
+	}
+	OSCServer::MethodHandlerId *drag_osc_id;
+	static void
+	drag_osc(LayerParticles *obj, lo_arg **argv)
+	{
+		obj->drag(argv[0]->f);
+	}
+
+	inline void
+	size(float start, float end)
+	{
+		size_start = start;
+		size_end = end;
+	}
+	OSCServer::MethodHandlerId *size_osc_id;
+	static void
+	size_osc(LayerParticles *obj, lo_arg **argv)
+	{
+		obj->size(argv[0]->f, argv[1]->f);
+	}
+
+	inline void
+	fade(float start, float end)
+	{
+		fade_start = start;
+		fade_end = end;
+	}
+	OSCServer::MethodHandlerId *fade_osc_id;
+	static void
+	fade_osc(LayerParticles *obj, lo_arg **argv)
+	{
+		obj->fade(argv[0]->f, argv[1]->f);
+	}
+
+	float random_unit();
+	void spawn(int count);
+	void simulate(float dt);
+};
+
+#endif
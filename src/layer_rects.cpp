@@ -0,0 +1,172 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <SDL.h>
+#include <SDL_gfxPrimitives.h>
+
+#include "osc_graphics.h"
+#include "surface.h"
+#include "layer_rects.h"
+
+/* upper bound for the number of rectangles */
+#define RECTS_MAX	65536
+
+Layer::CtorInfo LayerRects::ctor_info = {"rects", ""};
+
+LayerRects::LayerRects(const char *name, SDL_Rect geo, float opacity) :
+		      Layer(name), rects(NULL), num_rects(0), max_rects(0)
+{
+	rects_osc_id = register_method("rects", "b",
+				       (OSCServer::MethodHandlerCb)rects_osc);
+	count_osc_id = register_method("count", "i",
+				       (OSCServer::MethodHandlerCb)count_osc);
+	rect_osc_id = register_method("rect", "iiiiiiiii",
+				      (OSCServer::MethodHandlerCb)rect_osc);
+
+	LayerRects::geo(geo);
+	LayerRects::alpha(opacity);
+
+	store_method(count_osc_id, num_rects);
+}
+
+void
+LayerRects::geo(SDL_Rect geo)
+{
+	geov = geo;
+	if (!geov.w)
+		geov.w = screen->w;
+	if (!geov.h)
+		geov.h = screen->h;
+}
+
+void
+LayerRects::alpha(float opacity)
+{
+	alphav = opacity;
+}
+
+/*
+ * Sets the number of rectangles, new ones are empty
+ */
+void
+LayerRects::resize(int count)
+{
+	if (count > max_rects) {
+		rects = (Rect *)realloc(rects, count*sizeof(Rect));
+		max_rects = count;
+	}
+	if (count > num_rects)
+		memset(rects + num_rects, 0, (count - num_rects)*sizeof(Rect));
+	num_rects = count;
+}
+
+void
+LayerRects::set_rects(const Uint8 *data, int size)
+{
+	int count = size/RECTS_RECORD_SIZE;
+
+	if (size % RECTS_RECORD_SIZE)
+		WARNING_MSG("Rects blob size %d is not a multiple of %d",
+			    size, RECTS_RECORD_SIZE);
+	if (count > RECTS_MAX) {
+		WARNING_MSG("Too many rects (%d), only drawing %d",
+			    count, RECTS_MAX);
+		count = RECTS_MAX;
+	}
+
+	resize(count);
+
+	for (int i = 0; i < count; i++, data += RECTS_RECORD_SIZE) {
+		Rect *r = rects + i;
+
+		r->rect.x = (Sint16)(data[0] << 8 | data[1]);
+		r->rect.y = (Sint16)(data[2] << 8 | data[3]);
+		r->rect.w = (Uint16)(data[4] << 8 | data[5]);
+		r->rect.h = (Uint16)(data[6] << 8 | data[7]);
+		r->color.r = data[8];
+		r->color.g = data[9];
+		r->color.b = data[10];
+		r->alpha = data[11];
+		r->pixel = SDL_MapRGB(screen->format,
+				      r->color.r, r->color.g, r->color.b);
+	}
+}
+
+void
+LayerRects::count(int count)
+{
+	if (count < 0 || count > RECTS_MAX) {
+		WARNING_MSG("Invalid number of rects (%d)", count);
+		return;
+	}
+
+	resize(count);
+}
+
+void
+LayerRects::set_rect(int index, SDL_Rect rect, SDL_Color color, Uint8 alpha)
+{
+	Rect *r;
+
+	if (index < 0 || index >= RECTS_MAX) {
+		WARNING_MSG("Invalid rect index (%d)", index);
+		return;
+	}
+	if (index >= num_rects)
+		resize(index + 1);
+
+	r = rects + index;
+	r->rect = rect;
+	r->color = color;
+	r->alpha = alpha;
+	r->pixel = SDL_MapRGB(screen->format, color.r, color.g, color.b);
+}
+
+void
+LayerRects::frame(SDL_Surface *target)
+{
+	Uint32 opacity = (Uint32)ceilf(alphav*SDL_ALPHA_OPAQUE);
+	bool can_fill = surface_can_fill_blended(target);
+	SDL_Rect old_clip;
+
+	if (!opacity || !num_rects)
+		return;
+
+	SDL_GetClipRect(target, &old_clip);
+	SDL_SetClipRect(target, &geov);
+
+	for (int i = 0; i < num_rects; i++) {
+		Rect *r = rects + i;
+		SDL_Rect rect = r->rect;
+		Uint8 alpha = (Uint8)((r->alpha*opacity + 127)/SDL_ALPHA_OPAQUE);
+
+		if (!rect.w || !rect.h || alpha == SDL_ALPHA_TRANSPARENT)
+			continue;
+
+		rect.x += geov.x;
+		rect.y += geov.y;
+
+		if (can_fill || alpha == SDL_ALPHA_OPAQUE)
+			surface_fill_blended(target, &rect, r->pixel, alpha);
+		else
+			boxRGBA(target, rect.x, rect.y,
+				rect.x + rect.w - 1, rect.y + rect.h - 1,
+				r->color.r, r->color.g, r->color.b, alpha);
+	}
+
+	SDL_SetClipRect(target, &old_clip);
+}
+
+LayerRects::~LayerRects()
+{
+	unregister_method(rect_osc_id);
+	unregister_method(count_osc_id);
+	unregister_method(rects_osc_id);
+
+	free(rects);
+}
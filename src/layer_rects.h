@@ -0,0 +1,93 @@
+#ifndef __LAYER_RECTS_H
+#define __LAYER_RECTS_H
+
+#include <SDL.h>
+
+#include <lo/lo.h>
+
+#include "osc_graphics.h"
+#include "osc_server.h"
+#include "layer.h"
+
+/*
+ * Size of records in rects blobs:
+ * x, y (signed), w, h (16-bit each, network byte order), r, g, b, a
+ */
+#define RECTS_RECORD_SIZE 12
+
+/*
+ * Batch of filled rectangles, replaced by single messages with blobs of
+ * packed records. Coordinates are relative to the layer's geometry,
+ * which all rectangles are clipped to.
+ */
+class LayerRects : public Layer {
+	struct Rect {
+		SDL_Rect	rect;
+		SDL_Color	color;
+		Uint32		pixel;	/* color in display format */
+		Uint8		alpha;
+	};
+
+	Rect		*rects;
+	int		num_rects;
+	int		max_rects;	/* allocated */
+
+	SDL_Rect	geov;
+	float		alphav;
+
+public:
+	LayerRects(const char *name, SDL_Rect geo, float opacity);
+
+	static CtorInfo ctor_info;
+	static Layer *
+	ctor_osc(const char *name, SDL_Rect geo, float opacity,
+		 lo_arg **argv __attribute__((unused)))
+	{
+		return new LayerRects(name, geo, opacity);
+	}
+
+	~LayerRects();
+
+	void frame(SDL_Surface *target);
+
+private:
+	void geo(SDL_Rect geo);
+	void alpha(float opacity);
+
+	void set_rects(const Uint8 *data, int size);
+	OSCServer::MethodHandlerId *rects_osc_id;
+	static void
+	rects_osc(LayerRects *obj, lo_arg **argv)
+	{
+		obj->set_rects((const Uint8 *)lo_blob_dataptr((lo_blob)argv[0]),
+			       lo_blob_datasize((lo_blob)argv[0]));
+	}
+
+	/* for clients that cannot send blobs */
+	void count(int count);
+	OSCServer::MethodHandlerId *count_osc_id;
+	static void
+	count_osc(LayerRects *obj, lo_arg **argv)
+	{
+		obj->count(argv[0]->i);
+	}
+
+	void set_rect(int index, SDL_Rect rect, SDL_Color color, Uint8 alpha);
+	OSCServer::MethodHandlerId *rect_osc_id;
+	static void
+	rect_osc(LayerRects *obj, lo_arg **argv)
+	{
+		SDL_Rect rect = {
+			(Sint16)argv[1]->i, (Sint16)argv[2]->i,
+			(Uint16)argv[3]->i, (Uint16)argv[4]->i
+		};
+		SDL_Color color = {
+			(Uint8)argv[5]->i, (Uint8)argv[6]->i, (Uint8)argv[7]->i
+		};
+		obj->set_rect(argv[0]->i, rect, color, (Uint8)argv[8]->i);
+	}
+
+	void resize(int count);
+};
+
+#endif
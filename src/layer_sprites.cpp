@@ -0,0 +1,161 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <SDL.h>
+
+#include "osc_graphics.h"
+#include "worker_pool.h"
+#include "sprite_batch.h"
+#include "layer_sprites.h"
+
+/* upper bound for the number of instances */
+#define SPRITES_MAX	65536
+
+Layer::CtorInfo LayerSprites::ctor_info = {"sprites", "s" /* file */};
+
+LayerSprites::LayerSprites(const char *name, SDL_Rect geo, float opacity,
+			   const char *file) :
+			  Layer(name), atlas(this),
+			  instances(NULL), num_instances(0), max_instances(0)
+{
+	file_osc_id = register_method("file", "s",
+				      (OSCServer::MethodHandlerCb)file_osc);
+	grid_osc_id = register_method("grid", "ii",
+				      (OSCServer::MethodHandlerCb)grid_osc);
+	count_osc_id = register_method("count", "i",
+				       (OSCServer::MethodHandlerCb)count_osc);
+	instances_osc_id = register_method("instances", "ib",
+					   (OSCServer::MethodHandlerCb)instances_osc);
+	sprite_osc_id = register_method("sprite", "iiifii",
+					(OSCServer::MethodHandlerCb)sprite_osc);
+
+	LayerSprites::geo(geo);
+	LayerSprites::alpha(opacity);
+	if (file && *file)
+		LayerSprites::file(file);
+
+	store_method(grid_osc_id, 1, 1);
+	store_method(count_osc_id, num_instances);
+}
+
+void
+LayerSprites::geo(SDL_Rect geo)
+{
+	geov = geo;
+	if (!geov.w)
+		geov.w = screen->w;
+	if (!geov.h)
+		geov.h = screen->h;
+}
+
+void
+LayerSprites::alpha(float opacity)
+{
+	alphav = opacity;
+}
+
+/*
+ * Sets the number of instances, new ones are invisible
+ */
+void
+LayerSprites::resize(int count)
+{
+	if (count > max_instances) {
+		instances = (SpriteInstance *)
+			realloc(instances, count*sizeof(SpriteInstance));
+		max_instances = count;
+	}
+	if (count > num_instances)
+		memset(instances + num_instances, 0,
+		       (count - num_instances)*sizeof(SpriteInstance));
+	num_instances = count;
+}
+
+void
+LayerSprites::count(int count)
+{
+	if (count < 0 || count > SPRITES_MAX) {
+		WARNING_MSG("Invalid number of sprites (%d)", count);
+		return;
+	}
+
+	resize(count);
+}
+
+/*
+ * Updates count instances starting at first, so large numbers of
+ * instances can be sent in multiple messages
+ */
+void
+LayerSprites::set_instances(int first, const Uint8 *data, int size)
+{
+	int count = size/SPRITES_RECORD_SIZE;
+
+	if (size % SPRITES_RECORD_SIZE)
+		WARNING_MSG("Sprites blob size %d is not a multiple of %d",
+			    size, SPRITES_RECORD_SIZE);
+	if (first < 0 || count > SPRITES_MAX || first > SPRITES_MAX - count) {
+		WARNING_MSG("Invalid sprite range %d+%d", first, count);
+		return;
+	}
+
+	if (first + count > num_instances)
+		resize(first + count);
+
+	for (SpriteInstance *inst = instances + first;
+	     count; count--, inst++, data += SPRITES_RECORD_SIZE) {
+		inst->x = (Sint16)(data[0] << 8 | data[1]);
+		inst->y = (Sint16)(data[2] << 8 | data[3]);
+		inst->scale = (Uint16)(data[4] << 8 | data[5]);
+		inst->cell = (Uint16)(data[6] << 8 | data[7]);
+		inst->alpha = data[8];
+	}
+}
+
+void
+LayerSprites::set_instance(int index, Sint16 x, Sint16 y, float scale,
+			   int cell, Uint8 alpha)
+{
+	SpriteInstance *inst;
+
+	if (index < 0 || index >= SPRITES_MAX) {
+		WARNING_MSG("Invalid sprite index (%d)", index);
+		return;
+	}
+	if (index >= num_instances)
+		resize(index + 1);
+
+	inst = instances + index;
+	inst->x = x;
+	inst->y = y;
+	inst->scale = sprite_scale(scale);
+	inst->cell = (Uint16)cell;
+	inst->alpha = alpha;
+}
+
+void
+LayerSprites::frame(SDL_Surface *target)
+{
+	sprite_batch_draw(target, geov, atlas.cells, atlas.num_cells,
+			  instances, num_instances,
+			  (Uint8)ceilf(alphav*SDL_ALPHA_OPAQUE));
+}
+
+LayerSprites::~LayerSprites()
+{
+	unregister_method(sprite_osc_id);
+	unregister_method(instances_osc_id);
+	unregister_method(count_osc_id);
+	unregister_method(grid_osc_id);
+	unregister_method(file_osc_id);
+
+	/* atlas jobs are owned by the layer */
+	worker_pool.cancel(this);
+
+	free(instances);
+}
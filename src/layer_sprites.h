@@ -0,0 +1,114 @@
+#ifndef __LAYER_SPRITES_H
+#define __LAYER_SPRITES_H
+
+#include <SDL.h>
+
+#include <lo/lo.h>
+
+#include "osc_graphics.h"
+#include "osc_server.h"
+#include "sprite_batch.h"
+#include "layer.h"
+
+/*
+ * Size of records in instance blobs:
+ * x, y of the sprite's center (signed), scale (8.8 fixed point),
+ * atlas cell (16-bit each, network byte order), opacity and
+ * three reserved bytes
+ */
+#define SPRITES_RECORD_SIZE 12
+
+/*
+ * Draws many instances of the cells of a single image (atlas)
+ * at different positions, scales and opacities.
+ * Instances are updated in batches by blobs of packed records.
+ * Coordinates are relative to the layer's geometry, which all
+ * instances are clipped to.
+ */
+class LayerSprites : public Layer {
+	SpriteAtlas	atlas;
+
+	SpriteInstance	*instances;
+	int		num_instances;
+	int		max_instances;	/* allocated */
+
+	SDL_Rect	geov;
+	float		alphav;
+
+public:
+	LayerSprites(const char *name, SDL_Rect geo, float opacity,
+		     const char *file);
+
+	static CtorInfo ctor_info;
+	static Layer *
+	ctor_osc(const char *name, SDL_Rect geo, float opacity, lo_arg **argv)
+	{
+		return new LayerSprites(name, geo, opacity, &argv[0]->s);
+	}
+
+	~LayerSprites();
+
+	void frame(SDL_Surface *target);
+
+private:
+	void geo(SDL_Rect geo);
+	void alpha(float opacity);
+
+	inline void
+	file(const char *file)
+	{
+		atlas.file(file);
+	}
+	OSCServer::MethodHandlerId *file_osc_id;
+	static void
+	file_osc(LayerSprites *obj, lo_arg **argv)
+	{
+		obj->file(&argv[0]->s);
+	}
+
+	inline void
+	grid(int cols, int rows)
+	{
+		atlas.grid(cols, rows);
+	}
+	OSCServer::MethodHandlerId *grid_osc_id;
+	static void
+	grid_osc(LayerSprites *obj, lo_arg **argv)
+	{
+		obj->grid(argv[0]->i, argv[1]->i);
+	}
+
+	void count(int count);
+	OSCServer::MethodHandlerId *count_osc_id;
+	static void
+	count_osc(LayerSprites *obj, lo_arg **argv)
+	{
+		obj->count(argv[0]->i);
+	}
+
+	void set_instances(int first, const Uint8 *data, int size);
+	OSCServer::MethodHandlerId *instances_osc_id;
+	static void
+	instances_osc(LayerSprites *obj, lo_arg **argv)
+	{
+		obj->set_instances(argv[0]->i,
+				   (const Uint8 *)lo_blob_dataptr((lo_blob)argv[1]),
+				   lo_blob_datasize((lo_blob)argv[1]));
+	}
+
+	/* for clients that cannot send blobs */
+	void set_instance(int index, Sint16 x, Sint16 y, float scale,
+			  int cell, Uint8 alpha);
+	OSCServer::MethodHandlerId *sprite_osc_id;
+	static void
+	sprite_osc(LayerSprites *obj, lo_arg **argv)
+	{
+		obj->set_instance(argv[0]->i,
+				  (Sint16)argv[1]->i, (Sint16)argv[2]->i,
+				  argv[3]->f, argv[4]->i, (Uint8)argv[5]->i);
+	}
+
+	void resize(int count);
+};
+
+#endif
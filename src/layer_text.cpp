@@ -6,37 +6,45 @@
 #include <stdlib.h>
 #include <math.h>
 
-#ifdef __WIN32__
-#include <windows.h>
-#include <Shlwapi.h>
-#endif
-
 #include <SDL.h>
 #include <SDL_ttf.h>
 #include <SDL_rotozoom.h>
 
 #include "osc_graphics.h"
+#include "worker_pool.h"
+#include "surface.h"
 #include "layer_text.h"
 
+/*
+ * Macros
+ */
+#ifndef MIN
+#define MIN(A, B) ((A) < (B) ? (A) : (B))
+#endif
+
 Layer::CtorInfo LayerText::ctor_info = {
 	"text",
 	COLOR_TYPES "ss"	/* r, g, b, text, font file */
 };
 
-/*
- * Macros
- */
-#define TTF_CLOSEFONT_SAFE(FONT) do {	\
-	if (FONT) {			\
-		TTF_CloseFont(FONT);	\
-		FONT = NULL;		\
-	}				\
-} while (0)
+class LayerText::RenderJob : public WorkerPool::Job {
+public:
+	RenderJob(LayerText *layer) : WorkerPool::Job(layer) {}
+
+	void
+	run()
+	{
+		((LayerText *)owner)->render();
+	}
+};
 
 LayerText::LayerText(const char *name, SDL_Rect geo, float opacity,
 		     SDL_Color color, const char *text, const char *file)
-		    : Layer(name), ttf_font(NULL), surf_alpha(NULL), surf(NULL),
-		      textv(NULL), filev(NULL)
+		    : Layer(name), font_handle(NULL), stylev(TTF_STYLE_NORMAL),
+		      fitv(false),
+		      surf_alpha(NULL), surf(NULL),
+		      textv(NULL), filev(NULL), geov((SDL_Rect){0, 0, 0, 0}),
+		      render_pending(false), render_seq(0), rendered_seq(0)
 {
 	color_osc_id = register_method("color", COLOR_TYPES,
 				       (OSCServer::MethodHandlerCb)color_osc);
@@ -46,41 +54,62 @@ LayerText::LayerText(const char *name, SDL_Rect geo, float opacity,
 				      (OSCServer::MethodHandlerCb)font_osc);
 	style_osc_id = register_method("style", "s",
 				       (OSCServer::MethodHandlerCb)style_osc);
-
-	if (TTF_Init()) {
-		SDL_ERROR("TTF_Init");
-		exit(EXIT_FAILURE);
-	}
+	fit_osc_id = register_method("fit", "i",
+				     (OSCServer::MethodHandlerCb)fit_osc);
 
 	LayerText::geo(geo);
 	LayerText::alpha(opacity);
 	LayerText::color(color);
 	LayerText::text(text);
 	LayerText::font(file);
+
+	store_method(color_osc_id, color.r, color.g, color.b);
+	store_method(fit_osc_id, fitv);
 }
 
 void
 LayerText::geo(SDL_Rect geo)
 {
-	int style = TTF_STYLE_NORMAL;
+	bool resize;
 
+	if (!geo.h)
+		geo.h = screen->h;
+	resize = geo.w != geov.w || geo.h != geov.h;
 	geov = geo;
-	if (!geov.h)
-		geov.h = screen->h;
 
-	if (!filev)
-		return;
+	if (resize)
+		schedule_render();
+}
 
-	if (surf && (!geov.w || geov.w == surf->w) && geov.h == surf->h)
-		return;
+/*
+ * The default width is the width of the rendered text
+ */
+SDL_Rect
+LayerText::resolve_geo(SDL_Rect geo)
+{
+	if (!geo.w && surf)
+		geo.w = surf->w;
+	if (!geo.h)
+		geo.h = screen->h;
 
-	if (ttf_font) {
-		style = TTF_GetFontStyle(ttf_font);
-		TTF_CloseFont(ttf_font);
-	}
-	ttf_font = TTF_OpenFont(filev, geov.h);
+	return geo;
+}
 
-	LayerText::style(style);
+static SDL_Surface *
+alpha_surface_new(SDL_Surface *surf, Uint8 alpha)
+{
+	SDL_Surface *surf_alpha;
+
+	surf_alpha = SDL_CreateRGBSurface(surf->flags,
+					  surf->w, surf->h,
+					  surf->format->BitsPerPixel,
+					  surf->format->Rmask,
+					  surf->format->Gmask,
+					  surf->format->Bmask,
+					  surf->format->Amask);
+	rgba_blit_with_alpha(surf, surf_alpha, alpha);
+
+	return surf_alpha;
 }
 
 void
@@ -98,17 +127,10 @@ LayerText::alpha(float opacity)
 		return;
 	}
 
-	if (!surf_alpha) {
-		surf_alpha = SDL_CreateRGBSurface(surf->flags,
-						  surf->w, surf->h,
-						  surf->format->BitsPerPixel,
-						  surf->format->Rmask,
-						  surf->format->Gmask,
-						  surf->format->Bmask,
-						  surf->format->Amask);
-	}
-
-	rgba_blit_with_alpha(surf, surf_alpha, alpha);
+	if (surf_alpha)
+		rgba_blit_with_alpha(surf, surf_alpha, alpha);
+	else
+		surf_alpha = alpha_surface_new(surf, alpha);
 }
 
 void
@@ -116,71 +138,141 @@ LayerText::color(SDL_Color color)
 {
 	colorv = color;
 
-	if (!ttf_font)
-		return;
+	schedule_render();
+}
 
-	SDL_FREESURFACE_SAFE(surf_alpha);
-	SDL_FREESURFACE_SAFE(surf);
+void
+LayerText::schedule_render()
+{
+	render_seq++;
 
-	surf = TTF_RenderText_Blended(ttf_font, textv, colorv);
+	/* nothing can be rendered before the constructor sets the font */
+	if (!filev || render_pending)
+		return;
 
-	if (geov.w && surf->w != geov.w) {
-		SDL_Surface *new_surf;
+	render_pending = true;
+	worker_pool.push(new RenderJob(this));
+}
 
-		new_surf = zoomSurface(surf, (double)geov.w/surf->w, 1.0,
-				       SMOOTHING_ON);
-		SDL_FreeSurface(surf);
-		surf = new_surf;
+/*
+ * Gets the largest font of at most the given point size, which
+ * the text fits into width pixels with.
+ * Text widths are measured from glyph metrics, so only the final
+ * size is rasterized.
+ */
+static FontPoolFont *
+fit_font(const char *file, int size, int style, const char *text, int width)
+{
+	FontPoolFont *font = font_pool.get(file, size, style);
+	int text_w;
+
+	while (font) {
+		font_pool.lock();
+		text_w = font_pool.text_width(font, text);
+		font_pool.unlock();
+		if (text_w <= width || size <= 1)
+			break;
+
+		/*
+		 * Text widths are roughly proportional to the point size,
+		 * so this usually takes one or two steps
+		 */
+		font_pool.release(font);
+		size = MIN(size - 1, size*width/text_w);
+		if (size < 1)
+			size = 1;
+		font = font_pool.get(file, size, style);
 	}
 
-	alpha(alphav);
+	return font;
 }
 
-#ifdef __WIN32__
-
+/*
+ * Gets the font and rasterizes the text.
+ * Runs in a worker thread and repeats until the most recent request
+ * has been rendered. The layer is only locked while taking its
+ * properties and publishing the new surfaces, so the old surfaces are
+ * displayed until then.
+ * Results of requests superseded while rendering are published as well,
+ * so continuously changing text is still updated.
+ */
 void
-LayerText::font(const char *file)
+LayerText::render()
 {
-	free(filev);
+	lock();
+
+	while (rendered_seq != render_seq) {
+		Uint32 seq = render_seq;
+		FontPoolFont *new_font = NULL;
+		SDL_Surface *new_surf = NULL, *new_alpha = NULL;
+		char *file = filev ? strdup(filev) : NULL;
+		char *text = textv ? strdup(textv) : NULL;
+		SDL_Rect geo = geov;
+		int style = stylev;
+		bool fit = fitv;
+		SDL_Color color = colorv;
+		Uint8 alpha = (Uint8)ceilf(alphav*SDL_ALPHA_OPAQUE);
+
+		unlock();
+
+		/*
+		 * Fonts are shared with other layers (and never modified),
+		 * so changing the size or style means getting another font
+		 */
+		if (file && text && fit && geo.w)
+			new_font = fit_font(file, geo.h, style, text, geo.w);
+		else if (file)
+			new_font = font_pool.get(file, geo.h, style);
+		if (new_font && text)
+			new_surf = canvas.render(new_font, text, color);
+
+		if (new_surf && !fit && geo.w && new_surf->w != geo.w) {
+			SDL_Surface *zoomed;
+
+			zoomed = zoomSurface(new_surf, (double)geo.w/new_surf->w,
+					     1.0, SMOOTHING_ON);
+			SDL_FreeSurface(new_surf);
+			new_surf = zoomed;
+		}
+		if (new_surf) {
+			new_surf = surface_display_format(new_surf);
+			if (alpha < SDL_ALPHA_OPAQUE)
+				new_alpha = alpha_surface_new(new_surf, alpha);
+		}
+
+		free(file);
+		free(text);
+
+		lock();
+
+		SDL_FREESURFACE_SAFE(surf_alpha);
+		SDL_FREESURFACE_SAFE(surf);
+		if (font_handle)
+			font_pool.release(font_handle);
 
-	if (PathIsRelative(file)) {
-		/* relative path */
-		const char *systemroot = getenv("SYSTEMROOT");
-
-		filev = (char *)malloc(strlen(systemroot) + 7 + strlen(file) + 1);
-		strcpy(filev, systemroot);
-		strcat(filev, "\\fonts\\");
-		strcat(filev, file);
-	} else {
-		/* absolute path */
-		filev = strdup(file);
+		font_handle = new_font;
+		surf = new_surf;
+		surf_alpha = new_alpha;
+		rendered_seq = seq;
+
+		/* the opacity may have changed in the meantime */
+		if (alpha != (Uint8)ceilf(alphav*SDL_ALPHA_OPAQUE))
+			LayerText::alpha(alphav);
 	}
 
-	geo(geov);
+	render_pending = false;
+	unlock();
 }
 
-#else /* assume POSIX */
-
 void
 LayerText::font(const char *file)
 {
 	free(filev);
+	filev = font_path(file);
 
-	if (*file != '/') {
-		/* relative path */
-		filev = (char *)malloc(sizeof(FONT_PATH) + strlen(file));
-		strcpy(filev, FONT_PATH);
-		strcat(filev, file);
-	} else {
-		/* absolute path */
-		filev = strdup(file);
-	}
-
-	geo(geov);
+	schedule_render();
 }
 
-#endif
-
 void
 LayerText::style_osc(LayerText *obj, lo_arg **argv)
 {
@@ -209,6 +301,10 @@ void
 LayerText::frame(SDL_Surface *target)
 {
 	SDL_Surface *use_surf = surf_alpha ? : surf;
+
+	if (!use_surf)
+		return;
+
 	SDL_Rect dst_rect = {geov.x, geov.y, use_surf->w, use_surf->h};
 
 	SDL_BlitSurface(use_surf, NULL, target, &dst_rect);
@@ -216,13 +312,20 @@ LayerText::frame(SDL_Surface *target)
 
 LayerText::~LayerText()
 {
+	unregister_method(fit_osc_id);
 	unregister_method(style_osc_id);
 	unregister_method(font_osc_id);
 	unregister_method(text_osc_id);
 	unregister_method(color_osc_id);
 
+	worker_pool.cancel(this);
+	free(textv);
+	free(filev);
+
 	SDL_FREESURFACE_SAFE(surf);
 	SDL_FREESURFACE_SAFE(surf_alpha);
 
-	TTF_CLOSEFONT_SAFE(ttf_font);
+	canvas.reset();
+	if (font_handle)
+		font_pool.release(font_handle);
 }
@@ -9,10 +9,19 @@
 
 #include "osc_graphics.h"
 #include "osc_server.h"
+#include "font_pool.h"
+#include "text_canvas.h"
 #include "layer.h"
 
 class LayerText : public Layer {
-	TTF_Font	*ttf_font;
+	FontPoolFont	*font_handle;	/* font of surf (from font pool) */
+	int		stylev;
+	/*
+	 * Fit the text into the layer's width by reducing the point size
+	 * instead of stretching it
+	 */
+	bool		fitv;
+	TextCanvas	canvas;		/* composes surf from cached glyphs */
 
 	SDL_Surface	*surf_alpha;	/* with per-surface alpha */
 	SDL_Surface	*surf;		/* original text (possibly scaled) */
@@ -23,6 +32,16 @@ class LayerText : public Layer {
 	SDL_Rect	geov;
 	float		alphav;
 
+	/*
+	 * Text is rendered by a background job.
+	 * The currently displayed surfaces are only replaced when
+	 * the job has finished.
+	 */
+	class RenderJob;
+	bool		render_pending;	/* render job queued or running */
+	Uint32		render_seq;	/* incremented by every change */
+	Uint32		rendered_seq;	/* change surf was rendered for */
+
 public:
 	LayerText(const char *name, SDL_Rect geo, float opacity,
 		  SDL_Color color, const char *text, const char *file);
@@ -44,6 +63,7 @@ public:
 
 private:
 	void geo(SDL_Rect geo);
+	SDL_Rect resolve_geo(SDL_Rect geo);
 	void alpha(float opacity);
 
 	void color(SDL_Color color);
@@ -63,7 +83,7 @@ private:
 		free(textv);
 		textv = strdup(text);
 
-		color(colorv);
+		schedule_render();
 	}
 	OSCServer::MethodHandlerId *text_osc_id;
 	static void
@@ -80,15 +100,32 @@ private:
 		obj->font(&argv[0]->s);
 	}
 
+	void schedule_render();
+	void render();
+
 	inline void
 	style(int style)
 	{
-		TTF_SetFontStyle(ttf_font, style);
+		stylev = style;
 
-		color(colorv);
+		schedule_render();
 	}
 	OSCServer::MethodHandlerId *style_osc_id;
 	static void style_osc(LayerText *obj, lo_arg **argv);
+
+	inline void
+	fit(bool fit)
+	{
+		fitv = fit;
+
+		schedule_render();
+	}
+	OSCServer::MethodHandlerId *fit_osc_id;
+	static void
+	fit_osc(LayerText *obj, lo_arg **argv)
+	{
+		obj->fit(argv[0]->i);
+	}
 };
 
 #endif
\ No newline at end of file
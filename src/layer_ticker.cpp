@@ -0,0 +1,407 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <bsd/sys/queue.h>
+
+#include <SDL.h>
+
+#include "osc_graphics.h"
+#include "worker_pool.h"
+#include "font_pool.h"
+#include "surface.h"
+#include "layer_ticker.h"
+
+#define DEFAULT_SPEED	100.	/* pixels per second */
+
+Layer::CtorInfo LayerTicker::ctor_info = {
+	"ticker",
+	COLOR_TYPES "ss"	/* r, g, b, text, font file */
+};
+
+class LayerTicker::RenderJob : public WorkerPool::Job {
+public:
+	RenderJob(LayerTicker *layer) : WorkerPool::Job(layer) {}
+
+	void
+	run()
+	{
+		((LayerTicker *)owner)->render();
+	}
+};
+
+LayerTicker::LayerTicker(const char *name, SDL_Rect geo, float opacity,
+			 SDL_Color color, const char *text, const char *file)
+			: Layer(name), filev(NULL),
+			  geov((SDL_Rect){0, 0, 0, 0}), loopv(false),
+			  speedv(DEFAULT_SPEED),
+			  scroll_base(0.), scroll_ticks(SDL_GetTicks()),
+			  render_pending(false), generation(0),
+			  strip_end(0), last_char(0)
+{
+	TAILQ_INIT(&chunks);
+
+	color_osc_id = register_method("color", COLOR_TYPES,
+				       (OSCServer::MethodHandlerCb)color_osc);
+	text_osc_id = register_method("text", "s",
+				      (OSCServer::MethodHandlerCb)text_osc);
+	append_osc_id = register_method("append", "s",
+					(OSCServer::MethodHandlerCb)append_osc);
+	font_osc_id = register_method("font", "s",
+				      (OSCServer::MethodHandlerCb)font_osc);
+	speed_osc_id = register_method("speed", "f",
+				       (OSCServer::MethodHandlerCb)speed_osc);
+	loop_osc_id = register_method("loop", "i",
+				      (OSCServer::MethodHandlerCb)loop_osc);
+
+	LayerTicker::geo(geo);
+	LayerTicker::alpha(opacity);
+	LayerTicker::color(color);
+	LayerTicker::font(file);
+	LayerTicker::text(text);
+
+	store_method(color_osc_id, color.r, color.g, color.b);
+	store_method(speed_osc_id, speedv);
+	store_method(loop_osc_id, loopv);
+}
+
+void
+LayerTicker::geo(SDL_Rect geo)
+{
+	bool resize;
+
+	if (!geo.w)
+		geo.w = screen->w;
+	if (!geo.h)
+		geo.h = screen->h;
+	/* the height is the font size */
+	resize = geo.h != geov.h;
+	geov = geo;
+
+	if (resize)
+		rerender();
+}
+
+void
+LayerTicker::alpha(float opacity)
+{
+	alphav = opacity;
+}
+
+void
+LayerTicker::color(SDL_Color color)
+{
+	colorv = color;
+
+	rerender();
+}
+
+void
+LayerTicker::font(const char *file)
+{
+	free(filev);
+	filev = font_path(file);
+
+	rerender();
+}
+
+/*
+ * Replaces the text, which enters at the right edge again
+ */
+void
+LayerTicker::text(const char *text)
+{
+	clear();
+	rebase(0.);
+
+	append(text);
+}
+
+/*
+ * Appends text to the strip.
+ * If the strip has already scrolled in completely, the new text enters
+ * at the right edge.
+ */
+void
+LayerTicker::append(const char *text)
+{
+	while (*text) {
+		LayerTickerChunk *chunk = new LayerTickerChunk;
+		size_t len = strlen(text);
+
+		if (len > TICKER_CHUNK_CHARS)
+			len = TICKER_CHUNK_CHARS;
+
+		chunk->text = (char *)malloc(len + 1);
+		memcpy(chunk->text, text, len);
+		chunk->text[len] = '\0';
+		chunk->surf = NULL;
+		chunk->rendered = false;
+		chunk->origin = chunk->advance = 0;
+		chunk->placed = false;
+		chunk->x = 0;
+		TAILQ_INSERT_TAIL(&chunks, chunk, chunks);
+
+		text += len;
+	}
+
+	schedule_render();
+}
+
+void
+LayerTicker::speed(float speed)
+{
+	rebase(position());
+	speedv = speed;
+}
+
+void
+LayerTicker::rebase(double position)
+{
+	scroll_base = position;
+	scroll_ticks = SDL_GetTicks();
+}
+
+void
+LayerTicker::clear()
+{
+	LayerTickerChunk *chunk;
+
+	generation++;
+
+	while ((chunk = TAILQ_FIRST(&chunks))) {
+		TAILQ_REMOVE(&chunks, chunk, chunks);
+		SDL_FREESURFACE_SAFE(chunk->surf);
+		free(chunk->text);
+		delete chunk;
+	}
+
+	strip_end = 0;
+	last_char = 0;
+}
+
+/*
+ * Rasterizes all chunks again (e.g. with another font).
+ * Chunks keep their positions on the strip, starting with the first one.
+ */
+void
+LayerTicker::rerender()
+{
+	LayerTickerChunk *chunk;
+
+	generation++;
+
+	TAILQ_FOREACH(chunk, &chunks, chunks) {
+		SDL_FREESURFACE_SAFE(chunk->surf);
+		chunk->rendered = false;
+	}
+
+	chunk = TAILQ_FIRST(&chunks);
+	if (chunk && chunk->placed)
+		strip_end = chunk->x;
+	last_char = 0;
+
+	schedule_render();
+}
+
+void
+LayerTicker::schedule_render()
+{
+	/* nothing can be rendered before the constructor sets the font */
+	if (!filev || render_pending || TAILQ_EMPTY(&chunks))
+		return;
+
+	render_pending = true;
+	worker_pool.push(new RenderJob(this));
+}
+
+/*
+ * Rasterizes chunks in order.
+ * Runs in a worker thread until all chunks have been rasterized.
+ * The layer is only locked while inspecting and placing chunks.
+ */
+void
+LayerTicker::render()
+{
+	lock();
+
+	for (;;) {
+		LayerTickerChunk *chunk;
+		FontPoolFont *font = NULL;
+		SDL_Surface *surf = NULL;
+		int origin = 0, advance = 0, kern = 0;
+
+		TAILQ_FOREACH(chunk, &chunks, chunks)
+			if (!chunk->rendered)
+				break;
+		if (!chunk)
+			break;
+
+		unsigned int gen = generation;
+		char *text = strdup(chunk->text);
+		char *file = strdup(filev);
+		int size = geov.h;
+		SDL_Color color = colorv;
+		Uint8 prev = last_char;
+
+		unlock();
+
+		font = font_pool.get(file, size);
+		if (font) {
+			surf = canvas.render(font, text, color);
+			origin = canvas.origin();
+			advance = canvas.advance();
+
+			if (prev) {
+				font_pool.lock();
+				kern = font_pool.kerning(font, prev, (Uint8)*text);
+				font_pool.unlock();
+			}
+
+			font_pool.release(font);
+		}
+		free(file);
+
+		lock();
+
+		if (gen != generation) {
+			/* superseded, chunk may no longer exist */
+			SDL_FREESURFACE_SAFE(surf);
+			free(text);
+			continue;
+		}
+
+		chunk->surf = surf;
+		chunk->rendered = true;
+		chunk->origin = origin;
+		chunk->advance = advance;
+
+		chunk->x = strip_end + kern;
+		if (!chunk->placed) {
+			double pos = position();
+
+			/* never pop up on screen */
+			if (chunk->x < pos)
+				chunk->x = (int)ceil(pos);
+			chunk->placed = true;
+		}
+
+		strip_end = chunk->x + advance;
+		last_char = (Uint8)text[strlen(text) - 1];
+		free(text);
+	}
+
+	render_pending = false;
+	unlock();
+}
+
+static inline int
+chunk_right(LayerTickerChunk *chunk)
+{
+	int right = chunk->x + chunk->advance;
+
+	if (chunk->surf && chunk->x - chunk->origin + chunk->surf->w > right)
+		right = chunk->x - chunk->origin + chunk->surf->w;
+
+	return right;
+}
+
+/*
+ * Transparent layers are not drawn, so loops are wrapped and
+ * scrolled-out chunks dropped here, even while the layer is hidden
+ */
+bool
+LayerTicker::animated()
+{
+	double pos = position();
+	LayerTickerChunk *chunk;
+
+	if (loopv) {
+		LayerTickerChunk *first = TAILQ_FIRST(&chunks);
+		LayerTickerChunk *last = TAILQ_LAST(&chunks, layer_ticker_chunks);
+
+		/*
+		 * When the text has left the left edge, it enters
+		 * at the right edge again
+		 */
+		if (last && last->rendered &&
+		    pos - geov.w >= chunk_right(last)) {
+			pos = first->x + pos - geov.w - chunk_right(last);
+			rebase(pos);
+		}
+	} else {
+		/* chunks that have scrolled out are no longer needed */
+		while ((chunk = TAILQ_FIRST(&chunks)) && chunk->rendered &&
+		       chunk_right(chunk) <= pos - geov.w) {
+			TAILQ_REMOVE(&chunks, chunk, chunks);
+			SDL_FREESURFACE_SAFE(chunk->surf);
+			free(chunk->text);
+			delete chunk;
+		}
+	}
+
+	return speedv != 0.;
+}
+
+void
+LayerTicker::frame(SDL_Surface *target)
+{
+	Uint8 alpha = (Uint8)ceilf(alphav*SDL_ALPHA_OPAQUE);
+	double pos = position();
+	LayerTickerChunk *chunk;
+	SDL_Rect old_clip;
+
+	if (alpha == SDL_ALPHA_TRANSPARENT)
+		return;
+
+	SDL_GetClipRect(target, &old_clip);
+	SDL_SetClipRect(target, &geov);
+
+	TAILQ_FOREACH(chunk, &chunks, chunks) {
+		double x;
+
+		if (!chunk->placed)
+			break;
+		if (!chunk->surf)
+			continue;
+
+		x = geov.x + geov.w + chunk->x - chunk->origin - pos;
+		if (x >= geov.x + geov.w)
+			break;
+		if (x + chunk->surf->w <= geov.x)
+			continue;
+
+		if (surface_can_blit_scaled(chunk->surf, target)) {
+			surface_blit_scaled(chunk->surf, target,
+					    (Sint32)floor(x*0x10000),
+					    geov.y*0x10000,
+					    chunk->surf->w, chunk->surf->h,
+					    alpha);
+		} else {
+			/* whole pixel positions only, always opaque */
+			SDL_Rect dst_rect = {(Sint16)floor(x + .5), geov.y};
+
+			SDL_BlitSurface(chunk->surf, NULL, target, &dst_rect);
+		}
+	}
+
+	SDL_SetClipRect(target, &old_clip);
+}
+
+LayerTicker::~LayerTicker()
+{
+	unregister_method(loop_osc_id);
+	unregister_method(speed_osc_id);
+	unregister_method(font_osc_id);
+	unregister_method(append_osc_id);
+	unregister_method(text_osc_id);
+	unregister_method(color_osc_id);
+
+	worker_pool.cancel(this);
+
+	clear();
+	free(filev);
+}
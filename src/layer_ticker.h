@@ -0,0 +1,165 @@
+#ifndef __LAYER_TICKER_H
+#define __LAYER_TICKER_H
+
+#include <bsd/sys/queue.h>
+
+#include <SDL.h>
+
+#include <lo/lo.h>
+
+#include "osc_graphics.h"
+#include "osc_server.h"
+#include "text_canvas.h"
+#include "layer.h"
+
+/* maximum number of characters rasterized into one chunk */
+#define TICKER_CHUNK_CHARS 64
+
+/*
+ * Piece of the ticker text, rasterized separately
+ */
+struct LayerTickerChunk {
+	TAILQ_ENTRY(LayerTickerChunk) chunks;
+
+	char		*text;
+	SDL_Surface	*surf;		/* NULL if not rasterized (or failed) */
+	bool		rendered;
+
+	int		origin;		/* pen position of first glyph in surf */
+	int		advance;
+	bool		placed;
+	int		x;		/* pen position on the strip */
+};
+
+TAILQ_HEAD(layer_ticker_chunks, LayerTickerChunk);
+
+/*
+ * Scrolls text from right to left at a constant speed.
+ * The text is a strip of separately rasterized chunks, so appending text
+ * to endless feeds only rasterizes the new text and chunks that have
+ * scrolled out are dropped. Chunks are rasterized in the background and
+ * composited at sub-pixel positions.
+ */
+class LayerTicker : public Layer {
+	struct layer_ticker_chunks chunks;
+
+	char		*filev;
+	SDL_Color	colorv;
+	SDL_Rect	geov;
+	float		alphav;
+	bool		loopv;
+
+	/*
+	 * Scroll position on the strip, relative to the right edge
+	 * of the layer
+	 */
+	float		speedv;		/* pixels per second */
+	double		scroll_base;
+	Uint32		scroll_ticks;
+
+	/*
+	 * Chunks are rasterized by a background job in order.
+	 * The generation is incremented when all chunks have to be
+	 * rasterized again, so chunks rasterized concurrently are discarded.
+	 */
+	class RenderJob;
+	TextCanvas	canvas;
+	bool		render_pending;	/* render job queued or running */
+	unsigned int	generation;
+	int		strip_end;	/* pen position after last placed chunk */
+	Uint8		last_char;	/* of last placed chunk (for kerning) */
+
+public:
+	LayerTicker(const char *name, SDL_Rect geo, float opacity,
+		    SDL_Color color, const char *text, const char *file);
+
+	static CtorInfo ctor_info;
+	static Layer *
+	ctor_osc(const char *name, SDL_Rect geo, float opacity, lo_arg **argv)
+	{
+		SDL_Color color = {
+			(Uint8)argv[0]->i, (Uint8)argv[1]->i, (Uint8)argv[2]->i
+		};
+		return new LayerTicker(name, geo, opacity, color,
+				       &argv[3]->s, &argv[4]->s);
+	}
+
+	~LayerTicker();
+
+	bool animated();
+	void frame(SDL_Surface *target);
+
+private:
+	void geo(SDL_Rect geo);
+	void alpha(float opacity);
+
+	void color(SDL_Color color);
+	OSCServer::MethodHandlerId *color_osc_id;
+	static void
+	color_osc(LayerTicker *obj, lo_arg **argv)
+	{
+		SDL_Color color = {
+			(Uint8)argv[0]->i, (Uint8)argv[1]->i, (Uint8)argv[2]->i
+		};
+		obj->color(color);
+	}
+
+	void text(const char *text);
+	OSCServer::MethodHandlerId *text_osc_id;
+	static void
+	text_osc(LayerTicker *obj, lo_arg **argv)
+	{
+		obj->text(&argv[0]->s);
+	}
+
+	void append(const char *text);
+	OSCServer::MethodHandlerId *append_osc_id;
+	static void
+	append_osc(LayerTicker *obj, lo_arg **argv)
+	{
+		obj->append(&argv[0]->s);
+	}
+
+	void font(const char *file);
+	OSCServer::MethodHandlerId *font_osc_id;
+	static void
+	font_osc(LayerTicker *obj, lo_arg **argv)
+	{
+		obj->font(&argv[0]->s);
+	}
+
+	void speed(float speed);
+	OSCServer::MethodHandlerId *speed_osc_id;
+	static void
+	speed_osc(LayerTicker *obj, lo_arg **argv)
+	{
+		obj->speed(argv[0]->f);
+	}
+
+	inline void
+	loop(bool loop)
+	{
+		loopv = loop;
+	}
+	OSCServer::MethodHandlerId *loop_osc_id;
+	static void
+	loop_osc(LayerTicker *obj, lo_arg **argv)
+	{
+		obj->loop(argv[0]->i);
+	}
+
+	inline double
+	position()
+	{
+		return scroll_base +
+		       speedv*(SDL_GetTicks() - scroll_ticks)/1000.;
+	}
+	void rebase(double position);
+
+	void clear();
+	void rerender();
+	void schedule_render();
+	void render();
+};
+
+#endif
@@ -0,0 +1,724 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <math.h>
+
+#include <bsd/sys/queue.h>
+#include <bsd/sys/tree.h>
+
+#include <SDL.h>
+#include <SDL_image.h>
+#include <SDL_rotozoom.h>
+
+#include "osc_graphics.h"
+#include "worker_pool.h"
+#include "surface.h"
+#include "layer_tiles.h"
+
+/*
+ * Macros
+ */
+#define SDL_IMAGE_ERROR(FMT, ...) \
+	ERROR_MSG(FMT ": %s", ##__VA_ARGS__, IMG_GetError())
+
+#ifndef MIN
+#define MIN(A, B) ((A) < (B) ? (A) : (B))
+#endif
+#ifndef MAX
+#define MAX(A, B) ((A) > (B) ? (A) : (B))
+#endif
+
+Layer::CtorInfo LayerTiles::ctor_info = {"tiles", "s" /* file */};
+
+/*
+ * Maximum number of cached tiles (of 256x256 pixels by default).
+ * Must be larger than the number of tiles visible at once.
+ */
+#define TILES_MAX	256
+
+/*
+ * Maximum number of levels zoomed out for which tiles of the previous
+ * level are drawn while loading, each level quadrupling their number
+ */
+#define FALLBACK_MAX_SHIFT 2
+
+struct LayerTilesTile {
+	RB_ENTRY(LayerTilesTile) tiles;
+	TAILQ_ENTRY(LayerTilesTile) lru;
+
+	int		level, col, row;
+
+	SDL_Surface	*orig;		/* decoded tile without overlap */
+	SDL_Surface	*scaled;	/* scaled for scaled_id */
+	unsigned int	scaled_id;
+
+	bool		pending;	/* load job queued or running */
+	bool		failed;
+	bool		orphaned;	/* removed from cache while pending */
+
+	LayerTilesTile(int _level, int _col, int _row) :
+		      level(_level), col(_col), row(_row),
+		      orig(NULL), scaled(NULL), scaled_id(0),
+		      pending(false), failed(false), orphaned(false) {}
+
+	~LayerTilesTile()
+	{
+		SDL_FREESURFACE_SAFE(scaled);
+		SDL_FREESURFACE_SAFE(orig);
+	}
+};
+
+static inline int
+tile_cmp(LayerTilesTile *t1, LayerTilesTile *t2)
+{
+	if (t1->level != t2->level)
+		return t1->level < t2->level ? -1 : 1;
+	if (t1->row != t2->row)
+		return t1->row < t2->row ? -1 : 1;
+	if (t1->col != t2->col)
+		return t1->col < t2->col ? -1 : 1;
+	return 0;
+}
+
+RB_GENERATE(layer_tiles_tree, LayerTilesTile, tiles, tile_cmp);
+
+class LayerTiles::TileJob : public WorkerPool::Job {
+	LayerTilesTile *tile;
+	unsigned int id;
+	int w, h;
+
+public:
+	TileJob(LayerTiles *layer, LayerTilesTile *_tile,
+		unsigned int _id, int _w, int _h) :
+	       WorkerPool::Job(layer), tile(_tile), id(_id), w(_w), h(_h) {}
+
+	/*
+	 * Jobs of orphaned tiles may be cancelled before running,
+	 * so nobody else would free the tile
+	 */
+	~TileJob()
+	{
+		if (tile && tile->orphaned)
+			delete tile;
+	}
+
+	void
+	run()
+	{
+		((LayerTiles *)owner)->load_tile(tile, id, w, h);
+		/* may have been freed */
+		tile = NULL;
+	}
+};
+
+LayerTiles::LayerTiles(const char *name, SDL_Rect geo, float opacity,
+		       const char *file) :
+		      Layer(name),
+		      tiles_dir(NULL), tiles_format(NULL),
+		      image_w(0), image_h(0), tile_size(0), overlap(0),
+		      max_level(0),
+		      crop_x(0), crop_y(0), crop_w(0), crop_h(0),
+		      level(0), prev_level(-1),
+		      scale_x(1.), scale_y(1.), scale_id(0),
+		      pan_x(0), pan_y(0), num_tiles(0), tile_alpha(NULL)
+{
+	RB_INIT(&tiles);
+	TAILQ_INIT(&lru);
+
+	file_osc_id = register_method("file", "s",
+				      (OSCServer::MethodHandlerCb)file_osc);
+	crop_osc_id = register_method("crop", "iiii",
+				      (OSCServer::MethodHandlerCb)crop_osc);
+
+	LayerTiles::alpha(opacity);
+	LayerTiles::geo(geo);
+	if (file && *file)
+		LayerTiles::file(file);
+
+	store_method(crop_osc_id, crop_x, crop_y, crop_w, crop_h);
+}
+
+void
+LayerTiles::geo(SDL_Rect geo)
+{
+	geov = resolve_geo(geo);
+
+	update_view();
+}
+
+void
+LayerTiles::alpha(float opacity)
+{
+	alphav = opacity;
+}
+
+/*
+ * Very simple attribute lookup, sufficient for Deep Zoom descriptors
+ */
+static bool
+xml_get_attr(const char *xml, const char *name, char *value, size_t size)
+{
+	size_t name_len = strlen(name);
+	const char *p = xml;
+
+	while ((p = strstr(p, name))) {
+		if (p > xml && isspace(p[-1]) &&
+		    !strncmp(p + name_len, "=\"", 2)) {
+			size_t len;
+
+			p += name_len + 2;
+			len = strcspn(p, "\"");
+			if (len >= size)
+				len = size - 1;
+			memcpy(value, p, len);
+			value[len] = '\0';
+			return true;
+		}
+		p += name_len;
+	}
+
+	return false;
+}
+
+void
+LayerTiles::file(const char *file)
+{
+	char xml[4096], value[32];
+	char format[sizeof(value)];
+	int width, height, size, ov;
+	const char *ext;
+	char *dir;
+	size_t len;
+	FILE *f;
+
+	if (!file || !*file) {
+		clear_tiles();
+		free(tiles_dir);
+		tiles_dir = NULL;
+		return;
+	}
+
+	f = fopen(file, "r");
+	if (!f) {
+		ERROR_MSG("Cannot open Deep Zoom descriptor \"%s\"", file);
+		return;
+	}
+	len = fread(xml, 1, sizeof(xml) - 1, f);
+	fclose(f);
+	xml[len] = '\0';
+
+	if (!xml_get_attr(xml, "TileSize", value, sizeof(value)) ||
+	    (size = atoi(value)) <= 0 ||
+	    !xml_get_attr(xml, "Overlap", value, sizeof(value)) ||
+	    (ov = atoi(value)) < 0 ||
+	    !xml_get_attr(xml, "Format", format, sizeof(format)) ||
+	    !xml_get_attr(xml, "Width", value, sizeof(value)) ||
+	    (width = atoi(value)) <= 0 ||
+	    !xml_get_attr(xml, "Height", value, sizeof(value)) ||
+	    (height = atoi(value)) <= 0) {
+		ERROR_MSG("Invalid Deep Zoom descriptor \"%s\"", file);
+		return;
+	}
+
+	/* "image.dzi" -> "image_files/" */
+	ext = strrchr(file, '.');
+	if (!ext || strchr(ext, '/'))
+		ext = file + strlen(file);
+	dir = (char *)malloc(ext - file + sizeof("_files/"));
+	memcpy(dir, file, ext - file);
+	strcpy(dir + (ext - file), "_files/");
+
+	clear_tiles();
+	free(tiles_dir);
+	free(tiles_format);
+	tiles_dir = dir;
+	tiles_format = strdup(format);
+
+	image_w = width;
+	image_h = height;
+	tile_size = size;
+	overlap = ov;
+	for (max_level = 0; (1 << max_level) < MAX(width, height); max_level++);
+
+	update_view();
+}
+
+void
+LayerTiles::crop(int x, int y, int w, int h)
+{
+	/* remember the panning direction for prefetching */
+	if (w == crop_w && h == crop_h) {
+		pan_x = x > crop_x ? 1 : x < crop_x ? -1 : 0;
+		pan_y = y > crop_y ? 1 : y < crop_y ? -1 : 0;
+	} else {
+		pan_x = pan_y = 0;
+	}
+
+	crop_x = x;
+	crop_y = y;
+	crop_w = w;
+	crop_h = h;
+
+	update_view();
+}
+
+/*
+ * Chooses the smallest pyramid level whose resolution is at least
+ * the resolution required by the crop region and layer geometry.
+ */
+void
+LayerTiles::update_view()
+{
+	int w = crop_w > 0 ? crop_w : image_w;
+	int h = crop_h > 0 ? crop_h : image_h;
+	float factor, new_scale_x, new_scale_y;
+	int k = 0, new_level;
+
+	if (!tiles_dir || w <= 0 || h <= 0 || !geov.w || !geov.h)
+		return;
+
+	/* downsampling factor of full resolution to screen */
+	factor = MIN((float)w/geov.w, (float)h/geov.h);
+	while (k < max_level && (float)(2 << k) <= factor)
+		k++;
+
+	new_level = max_level - k;
+	new_scale_x = (float)geov.w*(1 << k)/w;
+	new_scale_y = (float)geov.h*(1 << k)/h;
+
+	if (new_level != level ||
+	    new_scale_x != scale_x || new_scale_y != scale_y) {
+		if (new_level != level)
+			prev_level = level;
+		level = new_level;
+		scale_x = new_scale_x;
+		scale_y = new_scale_y;
+		scale_id++;
+	}
+}
+
+void
+LayerTiles::clear_tiles()
+{
+	LayerTilesTile *tile, *next;
+
+	for (tile = RB_MIN(layer_tiles_tree, &tiles); tile; tile = next) {
+		next = RB_NEXT(layer_tiles_tree, &tiles, tile);
+
+		RB_REMOVE(layer_tiles_tree, &tiles, tile);
+		TAILQ_REMOVE(&lru, tile, lru);
+
+		/* freed by the load job */
+		if (tile->pending)
+			tile->orphaned = true;
+		else
+			delete tile;
+	}
+
+	num_tiles = 0;
+}
+
+LayerTilesTile *
+LayerTiles::get_tile(int col, int row)
+{
+	LayerTilesTile key(level, col, row);
+	LayerTilesTile *tile;
+
+	tile = RB_FIND(layer_tiles_tree, &tiles, &key);
+	if (tile) {
+		TAILQ_REMOVE(&lru, tile, lru);
+	} else {
+		tile = new LayerTilesTile(level, col, row);
+		RB_INSERT(layer_tiles_tree, &tiles, tile);
+		num_tiles++;
+	}
+	TAILQ_INSERT_HEAD(&lru, tile, lru);
+
+	return tile;
+}
+
+/*
+ * Screen rectangle of a tile relative to the cropped image.
+ * Tile edges are rounded consistently, so neighbouring tiles are
+ * seamless.
+ * Tiles of other levels are scaled by the powers of 2 between them.
+ */
+void
+LayerTiles::tile_rect(LayerTilesTile *tile, SDL_Rect &rect)
+{
+	float sx = ldexpf(scale_x, level - tile->level);
+	float sy = ldexpf(scale_y, level - tile->level);
+	int x1 = tile->col*tile_size;
+	int y1 = tile->row*tile_size;
+	int x2 = MIN(x1 + tile_size, level_size(image_w, tile->level));
+	int y2 = MIN(y1 + tile_size, level_size(image_h, tile->level));
+
+	rect.x = (Sint16)floorf(x1*sx);
+	rect.y = (Sint16)floorf(y1*sy);
+	rect.w = (Uint16)(floorf(x2*sx) - rect.x);
+	rect.h = (Uint16)(floorf(y2*sy) - rect.y);
+}
+
+void
+LayerTiles::request_tile(LayerTilesTile *tile)
+{
+	SDL_Rect rect;
+
+	if (tile->pending || tile->failed ||
+	    (tile->scaled && tile->scaled_id == scale_id))
+		return;
+
+	tile_rect(tile, rect);
+	if (!rect.w || !rect.h)
+		return;
+
+	tile->pending = true;
+	worker_pool.push(new TileJob(this, tile, scale_id, rect.w, rect.h));
+}
+
+void
+LayerTiles::evict_tiles()
+{
+	LayerTilesTile *tile = TAILQ_LAST(&lru, layer_tiles_lru);
+
+	while (tile && num_tiles > TILES_MAX) {
+		LayerTilesTile *prev = TAILQ_PREV(tile, layer_tiles_lru, lru);
+
+		if (!tile->pending) {
+			RB_REMOVE(layer_tiles_tree, &tiles, tile);
+			TAILQ_REMOVE(&lru, tile, lru);
+			delete tile;
+			num_tiles--;
+		}
+
+		tile = prev;
+	}
+}
+
+/*
+ * Loads a tile (unless already decoded) and scales it to the given size.
+ * Runs in a worker thread; the layer is only locked while inspecting
+ * and updating the tile.
+ */
+void
+LayerTiles::load_tile(LayerTilesTile *tile, unsigned int id, int w, int h)
+{
+	SDL_Surface *orig, *scaled = NULL;
+	char path[1024];
+
+	lock();
+
+	if (tile->orphaned || id != scale_id) {
+		/* superseded */
+		tile->pending = false;
+		if (tile->orphaned)
+			delete tile;
+		unlock();
+		return;
+	}
+
+	orig = tile->orig;
+	if (orig)
+		orig->refcount++;
+	snprintf(path, sizeof(path), "%s%d/%d_%d.%s",
+		 tiles_dir, tile->level, tile->col, tile->row, tiles_format);
+	int core_x = tile->col ? overlap : 0;
+	int core_y = tile->row ? overlap : 0;
+	int core_w = MIN(tile_size,
+			 level_size(image_w, tile->level) - tile->col*tile_size);
+	int core_h = MIN(tile_size,
+			 level_size(image_h, tile->level) - tile->row*tile_size);
+
+	unlock();
+
+	if (!orig) {
+		SDL_Surface *surf = IMG_Load(path);
+
+		if (surf)
+			surf = surface_display_format(surf);
+		else
+			SDL_IMAGE_ERROR("IMG_Load");
+
+		if (surf && core_x + core_w <= surf->w &&
+		    core_y + core_h <= surf->h) {
+			/* strip the overlap */
+			SDL_LockSurface(surf);
+			SDL_Surface *core = SDL_CreateRGBSurfaceFrom(
+				(Uint8 *)surf->pixels + core_y*surf->pitch +
+					core_x*surf->format->BytesPerPixel,
+				core_w, core_h, surf->format->BitsPerPixel,
+				surf->pitch,
+				surf->format->Rmask, surf->format->Gmask,
+				surf->format->Bmask, surf->format->Amask);
+			if (core) {
+				orig = SDL_ConvertSurface(core, surf->format,
+							  surf->flags);
+				SDL_FreeSurface(core);
+			}
+			SDL_UnlockSurface(surf);
+		} else if (surf) {
+			ERROR_MSG("Invalid tile size of \"%s\"", path);
+		}
+
+		SDL_FREESURFACE_SAFE(surf);
+	}
+
+	if (orig) {
+		if (orig->w == w && orig->h == h) {
+			scaled = orig;
+			scaled->refcount++;
+		} else {
+			scaled = zoomSurface(orig, (double)w/orig->w,
+					     (double)h/orig->h, SMOOTHING_ON);
+			if (scaled)
+				scaled = surface_display_format(scaled);
+		}
+	}
+
+	lock();
+
+	tile->pending = false;
+
+	if (tile->orphaned) {
+		SDL_FREESURFACE_SAFE(scaled);
+		SDL_FREESURFACE_SAFE(orig);
+		delete tile;
+		unlock();
+		return;
+	}
+
+	if (!tile->orig) {
+		tile->orig = orig;
+		tile->failed = !orig;
+	} else {
+		SDL_FREESURFACE_SAFE(orig);
+	}
+
+	if (scaled && id == scale_id) {
+		SDL_FREESURFACE_SAFE(tile->scaled);
+		tile->scaled = scaled;
+		tile->scaled_id = id;
+	} else {
+		SDL_FREESURFACE_SAFE(scaled);
+	}
+
+	unlock();
+}
+
+/*
+ * SDL ignores the per-surface alpha of surfaces with alpha channel,
+ * so the layer opacity of such tiles is applied by blending them
+ * with surface_blit_scaled() or, if the formats are not supported,
+ * by blitting an alpha-modulated copy
+ */
+void
+LayerTiles::blit_tile(SDL_Surface *tile, SDL_Surface *target,
+		      SDL_Rect &rect, Uint8 alpha)
+{
+	if (!tile->format->Amask) {
+		if (alpha == SDL_ALPHA_OPAQUE)
+			SDL_SetAlpha(tile, 0, 0);
+		else
+			SDL_SetAlpha(tile, SDL_SRCALPHA, alpha);
+	} else if (alpha < SDL_ALPHA_OPAQUE) {
+		if (surface_can_blit_scaled(tile, target)) {
+			surface_blit_scaled(tile, target,
+					    rect.x*0x10000, rect.y*0x10000,
+					    tile->w, tile->h, alpha);
+			return;
+		}
+
+		/* tiles share the format, but edge tiles are smaller */
+		if (!tile_alpha ||
+		    tile_alpha->w != tile->w || tile_alpha->h != tile->h) {
+			SDL_FREESURFACE_SAFE(tile_alpha);
+			tile_alpha = SDL_CreateRGBSurface(tile->flags,
+							  tile->w, tile->h,
+							  tile->format->BitsPerPixel,
+							  tile->format->Rmask,
+							  tile->format->Gmask,
+							  tile->format->Bmask,
+							  tile->format->Amask);
+			if (!tile_alpha) {
+				SDL_ERROR("SDL_CreateRGBSurface");
+				return;
+			}
+		}
+		rgba_blit_with_alpha(tile, tile_alpha, alpha);
+		tile = tile_alpha;
+	}
+
+	SDL_BlitSurface(tile, NULL, target, &rect);
+}
+
+/*
+ * Covers the screen rectangle of a tile that is not available yet with
+ * the loaded tiles of the previously displayed level, so zooming does
+ * not flash blank areas.
+ * The tiles are scaled while compositing, so this requires formats
+ * supported by surface_blit_scaled().
+ */
+void
+LayerTiles::draw_fallback(LayerTilesTile *tile, SDL_Surface *target,
+			  SDL_Rect &rect, int dx, int dy, Uint8 alpha)
+{
+	int shift = prev_level - level;
+	int x1, y1, x2, y2;	/* area of tile in previous level pixels */
+	SDL_Rect old_clip, clip;
+
+	if (prev_level < 0 || !shift || shift > FALLBACK_MAX_SHIFT)
+		return;
+
+	x1 = tile->col*tile_size;
+	y1 = tile->row*tile_size;
+	x2 = x1 + tile_size;
+	y2 = y1 + tile_size;
+	if (shift > 0) {
+		x1 <<= shift;
+		y1 <<= shift;
+		x2 <<= shift;
+		y2 <<= shift;
+	} else {
+		x1 >>= -shift;
+		y1 >>= -shift;
+		x2 = (x2 + (1 << -shift) - 1) >> -shift;
+		y2 = (y2 + (1 << -shift) - 1) >> -shift;
+	}
+
+	/* only the tile's rectangle within the layer */
+	SDL_GetClipRect(target, &old_clip);
+	clip.x = MAX(rect.x, old_clip.x);
+	clip.y = MAX(rect.y, old_clip.y);
+	clip.w = MAX(MIN(rect.x + rect.w, old_clip.x + old_clip.w) - clip.x, 0);
+	clip.h = MAX(MIN(rect.y + rect.h, old_clip.y + old_clip.h) - clip.y, 0);
+	if (!clip.w || !clip.h)
+		return;
+	SDL_SetClipRect(target, &clip);
+
+	for (int row = y1/tile_size; row <= (y2 - 1)/tile_size; row++) {
+		for (int col = x1/tile_size; col <= (x2 - 1)/tile_size; col++) {
+			LayerTilesTile key(prev_level, col, row);
+			LayerTilesTile *prev;
+			SDL_Rect prev_rect;
+
+			prev = RB_FIND(layer_tiles_tree, &tiles, &key);
+			if (!prev || !prev->orig ||
+			    !surface_can_blit_scaled(prev->orig, target))
+				continue;
+
+			/* keep it cached until it has been replaced */
+			TAILQ_REMOVE(&lru, prev, lru);
+			TAILQ_INSERT_HEAD(&lru, prev, lru);
+
+			tile_rect(prev, prev_rect);
+			surface_blit_scaled(prev->orig, target,
+					    (prev_rect.x + dx)*0x10000,
+					    (prev_rect.y + dy)*0x10000,
+					    prev_rect.w, prev_rect.h, alpha);
+		}
+	}
+
+	SDL_SetClipRect(target, &old_clip);
+}
+
+void
+LayerTiles::frame(SDL_Surface *target)
+{
+	SDL_Rect old_clip;
+	Uint8 alpha = (Uint8)ceilf(alphav*SDL_ALPHA_OPAQUE);
+	int k = max_level - level;
+	int x1, y1, x2, y2, cols, rows;
+	int off_x, off_y;
+
+	if (!tiles_dir)
+		return;
+
+	/* visible region in level coordinates */
+	x1 = (crop_x >> k);
+	y1 = (crop_y >> k);
+	x2 = x1 + (int)ceilf(geov.w/scale_x);
+	y2 = y1 + (int)ceilf(geov.h/scale_y);
+	off_x = (int)floorf(x1*scale_x);
+	off_y = (int)floorf(y1*scale_y);
+
+	cols = (level_size(image_w, level) + tile_size - 1)/tile_size;
+	rows = (level_size(image_h, level) + tile_size - 1)/tile_size;
+
+	int c1 = MAX(x1/tile_size, 0);
+	int r1 = MAX(y1/tile_size, 0);
+	int c2 = MIN(x2/tile_size, cols - 1);
+	int r2 = MIN(y2/tile_size, rows - 1);
+
+	SDL_GetClipRect(target, &old_clip);
+	SDL_SetClipRect(target, &geov);
+
+	for (int row = r1; row <= r2; row++) {
+		for (int col = c1; col <= c2; col++) {
+			LayerTilesTile *tile = get_tile(col, row);
+			SDL_Rect rect;
+
+			request_tile(tile);
+
+			tile_rect(tile, rect);
+			rect.x += geov.x - off_x;
+			rect.y += geov.y - off_y;
+
+			/*
+			 * Tiles scaled for a previous zoom are displayed
+			 * until the rescaled tile is available
+			 */
+			if (tile->scaled)
+				blit_tile(tile->scaled, target, rect, alpha);
+			else
+				draw_fallback(tile, target, rect,
+					      geov.x - off_x, geov.y - off_y,
+					      alpha);
+		}
+	}
+
+	SDL_SetClipRect(target, &old_clip);
+
+	/* prefetch the tiles next to the visible ones in panning direction */
+	if (pan_x) {
+		int col = pan_x > 0 ? c2 + 1 : c1 - 1;
+
+		if (col >= 0 && col < cols)
+			for (int row = r1; row <= r2; row++)
+				request_tile(get_tile(col, row));
+	}
+	if (pan_y) {
+		int row = pan_y > 0 ? r2 + 1 : r1 - 1;
+
+		if (row >= 0 && row < rows)
+			for (int col = c1; col <= c2; col++)
+				request_tile(get_tile(col, row));
+	}
+
+	evict_tiles();
+}
+
+LayerTiles::~LayerTiles()
+{
+	LayerTilesTile *tile, *next;
+
+	unregister_method(file_osc_id);
+	unregister_method(crop_osc_id);
+
+	worker_pool.cancel(this);
+
+	for (tile = RB_MIN(layer_tiles_tree, &tiles); tile; tile = next) {
+		next = RB_NEXT(layer_tiles_tree, &tiles, tile);
+		RB_REMOVE(layer_tiles_tree, &tiles, tile);
+		delete tile;
+	}
+
+	SDL_FREESURFACE_SAFE(tile_alpha);
+
+	free(tiles_dir);
+	free(tiles_format);
+}
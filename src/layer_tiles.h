@@ -0,0 +1,119 @@
+#ifndef __LAYER_TILES_H
+#define __LAYER_TILES_H
+
+#include <bsd/sys/queue.h>
+#include <bsd/sys/tree.h>
+
+#include <SDL.h>
+
+#include <lo/lo.h>
+
+#include "osc_graphics.h"
+#include "osc_server.h"
+#include "layer.h"
+
+/* defined in layer_tiles.cpp */
+struct LayerTilesTile;
+
+RB_HEAD(layer_tiles_tree, LayerTilesTile);
+TAILQ_HEAD(layer_tiles_lru, LayerTilesTile);
+
+/*
+ * Displays a region of a (huge) image stored as a Deep Zoom tile
+ * pyramid (*.dzi plus *_files/ directory).
+ * Only visible tiles of the pyramid level required for the current
+ * zoom are loaded, in the background, and kept in a bounded LRU cache.
+ */
+class LayerTiles : public Layer {
+	class TileJob;
+
+	/* pyramid */
+	char		*tiles_dir;	/* e.g. "image_files/" */
+	char		*tiles_format;	/* file name extension */
+	int		image_w, image_h;
+	int		tile_size;
+	int		overlap;
+	int		max_level;	/* full resolution level */
+
+	/* view */
+	SDL_Rect	geov;
+	float		alphav;
+	/* in full resolution coordinates, all 0 for the whole image */
+	int		crop_x, crop_y, crop_w, crop_h;
+
+	int		level;		/* pyramid level displayed */
+	int		prev_level;	/* displayed before, -1 if none */
+	float		scale_x, scale_y; /* level pixels to screen pixels */
+	unsigned int	scale_id;	/* changes with level and scale */
+	int		pan_x, pan_y;	/* last panning direction */
+
+	/* tile cache */
+	struct layer_tiles_tree tiles;
+	struct layer_tiles_lru lru;
+	int		num_tiles;
+
+	/* alpha-modulated copy of a tile with alpha channel */
+	SDL_Surface	*tile_alpha;
+
+public:
+	LayerTiles(const char *name, SDL_Rect geo, float opacity,
+		   const char *file);
+
+	static CtorInfo ctor_info;
+	static Layer *
+	ctor_osc(const char *name, SDL_Rect geo, float opacity, lo_arg **argv)
+	{
+		return new LayerTiles(name, geo, opacity, &argv[0]->s);
+	}
+
+	~LayerTiles();
+
+	void frame(SDL_Surface *target);
+
+private:
+	void geo(SDL_Rect geo);
+	SDL_Rect
+	resolve_geo(SDL_Rect geo)
+	{
+		return resolve_null_geo(geo);
+	}
+	void alpha(float opacity);
+
+	void file(const char *file);
+	OSCServer::MethodHandlerId *file_osc_id;
+	static void
+	file_osc(LayerTiles *obj, lo_arg **argv)
+	{
+		obj->file(&argv[0]->s);
+	}
+
+	void crop(int x, int y, int w, int h);
+	OSCServer::MethodHandlerId *crop_osc_id;
+	static void
+	crop_osc(LayerTiles *obj, lo_arg **argv)
+	{
+		obj->crop(argv[0]->i, argv[1]->i, argv[2]->i, argv[3]->i);
+	}
+
+	void update_view();
+	void clear_tiles();
+
+	inline int
+	level_size(int size, int l)
+	{
+		return (size + (1 << (max_level - l)) - 1) >> (max_level - l);
+	}
+
+	LayerTilesTile *get_tile(int col, int row);
+	void request_tile(LayerTilesTile *tile);
+	void evict_tiles();
+	void load_tile(LayerTilesTile *tile, unsigned int id,
+		       int w, int h);
+	void tile_rect(LayerTilesTile *tile, SDL_Rect &rect);
+	void blit_tile(SDL_Surface *tile, SDL_Surface *target,
+		       SDL_Rect &rect, Uint8 alpha);
+	void draw_fallback(LayerTilesTile *tile, SDL_Surface *target,
+			   SDL_Rect &rect, int dx, int dy, Uint8 alpha);
+};
+
+#endif
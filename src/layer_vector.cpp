@@ -0,0 +1,265 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <SDL.h>
+#include <SDL_gfxPrimitives.h>
+
+#include "osc_graphics.h"
+#include "worker_pool.h"
+#include "surface.h"
+#include "layer_vector.h"
+
+Layer::CtorInfo LayerVector::ctor_info = {"vector", ""};
+
+/*
+ * SDL_gfx's polygon filler uses a global buffer,
+ * so display lists of different layers must not fill polygons
+ * concurrently
+ */
+static Mutex polygon_mutex;
+
+class LayerVector::RenderJob : public WorkerPool::Job {
+public:
+	RenderJob(LayerVector *layer) : WorkerPool::Job(layer) {}
+
+	void
+	run()
+	{
+		((LayerVector *)owner)->render();
+	}
+};
+
+LayerVector::LayerVector(const char *name, SDL_Rect geo, float opacity) :
+			Layer(name), surf(NULL),
+			list(NULL), list_size(0), surf_w(0), surf_h(0),
+			pending(NULL), pending_size(0), render_pending(false)
+{
+	list_osc_id = register_method("list", "b",
+				      (OSCServer::MethodHandlerCb)list_osc);
+
+	LayerVector::geo(geo);
+	LayerVector::alpha(opacity);
+}
+
+void
+LayerVector::geo(SDL_Rect geo)
+{
+	geov = geo;
+	if (!geov.w)
+		geov.w = screen->w;
+	if (!geov.h)
+		geov.h = screen->h;
+
+	if (list && (geov.w != surf_w || geov.h != surf_h))
+		schedule_render();
+}
+
+void
+LayerVector::alpha(float opacity)
+{
+	alphav = opacity;
+}
+
+void
+LayerVector::set_list(const Uint8 *data, int size)
+{
+	/*
+	 * Unchanged display lists are not rasterized again.
+	 * While rendering, list may already be superseded by a list
+	 * taken by the render job, so the list is always queued.
+	 */
+	if (!render_pending && list && size == list_size &&
+	    !memcmp(data, list, size))
+		return;
+
+	free(pending);
+	pending = (Uint8 *)malloc(size);
+	memcpy(pending, data, size);
+	pending_size = size;
+
+	schedule_render();
+}
+
+void
+LayerVector::schedule_render()
+{
+	if (render_pending)
+		return;
+
+	render_pending = true;
+	worker_pool.push(new RenderJob(this));
+}
+
+static inline Sint16
+get_16(const Uint8 *p)
+{
+	return (Sint16)(p[0] << 8 | p[1]);
+}
+
+/*
+ * Rasterizes a display list into a new surface with alpha channel.
+ * Primitives are drawn with SDL_gfx's antialiased line and circle
+ * algorithms and its span-based polygon and disc fillers.
+ */
+static SDL_Surface *
+rasterize(const Uint8 *data, int size, int w, int h)
+{
+	SDL_Surface *surf = surface_new_alpha(w, h);
+	Sint16 *vx = NULL, *vy = NULL;
+	int max_points = 0;
+
+	if (!surf)
+		return NULL;
+	SDL_FillRect(surf, NULL, SDL_MapRGBA(surf->format, 0, 0, 0,
+					     SDL_ALPHA_TRANSPARENT));
+
+	while (size >= VECTOR_HEADER_SIZE) {
+		Uint8 opcode = data[0];
+		int n = (Uint16)get_16(data + 2);
+		Uint8 r = data[4], g = data[5], b = data[6], a = data[7];
+
+		data += VECTOR_HEADER_SIZE;
+		size -= VECTOR_HEADER_SIZE;
+		if (n*VECTOR_POINT_SIZE > size) {
+			WARNING_MSG("Truncated vector display list");
+			break;
+		}
+
+		if (n > max_points) {
+			vx = (Sint16 *)realloc(vx, n*sizeof(Sint16));
+			vy = (Sint16 *)realloc(vy, n*sizeof(Sint16));
+			max_points = n;
+		}
+		for (int i = 0; i < n; i++) {
+			vx[i] = get_16(data + i*VECTOR_POINT_SIZE);
+			vy[i] = get_16(data + i*VECTOR_POINT_SIZE + 2);
+		}
+		data += n*VECTOR_POINT_SIZE;
+		size -= n*VECTOR_POINT_SIZE;
+
+		switch (opcode) {
+		case VECTOR_LINES:
+			for (int i = 0; i + 1 < n; i += 2)
+				aalineRGBA(surf, vx[i], vy[i],
+					   vx[i + 1], vy[i + 1], r, g, b, a);
+			break;
+		case VECTOR_POLYLINE:
+			for (int i = 0; i + 1 < n; i++)
+				aalineRGBA(surf, vx[i], vy[i],
+					   vx[i + 1], vy[i + 1], r, g, b, a);
+			break;
+		case VECTOR_CIRCLES:
+			for (int i = 0; i + 1 < n; i += 2)
+				aacircleRGBA(surf, vx[i], vy[i], vx[i + 1],
+					     r, g, b, a);
+			break;
+		case VECTOR_DISCS:
+			for (int i = 0; i + 1 < n; i += 2) {
+				filledCircleRGBA(surf, vx[i], vy[i], vx[i + 1],
+						 r, g, b, a);
+				/* antialiased edge */
+				aacircleRGBA(surf, vx[i], vy[i], vx[i + 1],
+					     r, g, b, a);
+			}
+			break;
+		case VECTOR_POLYGON:
+			if (n < 3)
+				break;
+			polygon_mutex.lock();
+			filledPolygonRGBA(surf, vx, vy, n, r, g, b, a);
+			polygon_mutex.unlock();
+			aapolygonRGBA(surf, vx, vy, n, r, g, b, a);
+			break;
+		default:
+			WARNING_MSG("Invalid vector opcode %d", opcode);
+			break;
+		}
+	}
+
+	free(vx);
+	free(vy);
+
+	return surf;
+}
+
+/*
+ * Rasterizes pending display lists and rasterizes the current display
+ * list again when the layer has been resized.
+ * Runs in a worker thread until the surface is up to date.
+ * The layer is only locked while inspecting and replacing its surface.
+ */
+void
+LayerVector::render()
+{
+	lock();
+
+	for (;;) {
+		SDL_Surface *new_surf;
+		Uint8 *data;
+		int size, w, h;
+
+		if (pending) {
+			data = pending;
+			size = pending_size;
+			pending = NULL;
+		} else if (list && (geov.w != surf_w || geov.h != surf_h)) {
+			data = list;
+			size = list_size;
+		} else {
+			break;
+		}
+		w = geov.w;
+		h = geov.h;
+
+		unlock();
+		new_surf = rasterize(data, size, w, h);
+		lock();
+
+		SDL_FREESURFACE_SAFE(surf);
+		surf = new_surf;
+		surf_w = w;
+		surf_h = h;
+		if (data != list) {
+			free(list);
+			list = data;
+			list_size = size;
+		}
+	}
+
+	render_pending = false;
+	unlock();
+}
+
+void
+LayerVector::frame(SDL_Surface *target)
+{
+	Uint8 alpha = (Uint8)ceilf(alphav*SDL_ALPHA_OPAQUE);
+	SDL_Rect dst_rect = {geov.x, geov.y};
+
+	if (!surf || alpha == SDL_ALPHA_TRANSPARENT)
+		return;
+
+	if (surface_can_blit_scaled(surf, target))
+		/* unscaled, but supports the layer's opacity */
+		surface_blit_scaled(surf, target,
+				    geov.x*0x10000, geov.y*0x10000,
+				    surf->w, surf->h, alpha);
+	else
+		SDL_BlitSurface(surf, NULL, target, &dst_rect);
+}
+
+LayerVector::~LayerVector()
+{
+	unregister_method(list_osc_id);
+
+	worker_pool.cancel(this);
+	free(pending);
+	free(list);
+
+	SDL_FREESURFACE_SAFE(surf);
+}
@@ -0,0 +1,86 @@
+#ifndef __LAYER_VECTOR_H
+#define __LAYER_VECTOR_H
+
+#include <SDL.h>
+
+#include <lo/lo.h>
+
+#include "osc_graphics.h"
+#include "osc_server.h"
+#include "layer.h"
+
+/*
+ * Display list commands.
+ * Every command starts with a header of opcode, a reserved byte,
+ * number of points (16-bit), r, g, b and a, followed by the points
+ * (x and y, signed 16-bit each).
+ * 16-bit values are in network byte order.
+ */
+#define VECTOR_HEADER_SIZE	8
+#define VECTOR_POINT_SIZE	4
+
+enum VectorOpcode {
+	VECTOR_LINES = 1,	/* pairs of points */
+	VECTOR_POLYLINE,
+	VECTOR_CIRCLES,		/* centers followed by (radius, 0) */
+	VECTOR_DISCS,		/* like circles, but filled */
+	VECTOR_POLYGON		/* filled */
+};
+
+/*
+ * Draws display lists of antialiased vector primitives, sent as blobs.
+ * Display lists are rasterized in the background and the result is
+ * cached until the display list or the layer's size changes.
+ * Coordinates are relative to the layer's geometry.
+ */
+class LayerVector : public Layer {
+	SDL_Surface	*surf;		/* rasterized display list */
+	Uint8		*list;		/* display list of surf */
+	int		list_size;
+	int		surf_w, surf_h;	/* size surf was rasterized for */
+
+	SDL_Rect	geov;
+	float		alphav;
+
+	/*
+	 * Display lists are rasterized by a background job.
+	 * The current surface is only replaced when the job has finished.
+	 */
+	class RenderJob;
+	Uint8		*pending;	/* display list to rasterize or NULL */
+	int		pending_size;
+	bool		render_pending;	/* render job queued or running */
+
+public:
+	LayerVector(const char *name, SDL_Rect geo, float opacity);
+
+	static CtorInfo ctor_info;
+	static Layer *
+	ctor_osc(const char *name, SDL_Rect geo, float opacity,
+		 lo_arg **argv __attribute__((unused)))
+	{
+		return new LayerVector(name, geo, opacity);
+	}
+
+	~LayerVector();
+
+	void frame(SDL_Surface *target);
+
+private:
+	void geo(SDL_Rect geo);
+	void alpha(float opacity);
+
+	void set_list(const Uint8 *data, int size);
+	OSCServer::MethodHandlerId *list_osc_id;
+	static void
+	list_osc(LayerVector *obj, lo_arg **argv)
+	{
+		obj->set_list((const Uint8 *)lo_blob_dataptr((lo_blob)argv[0]),
+			      lo_blob_datasize((lo_blob)argv[0]));
+	}
+
+	void schedule_render();
+	void render();
+};
+
+#endif
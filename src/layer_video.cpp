@@ -3,7 +3,10 @@
 #endif
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <bsd/sys/queue.h>
 
 #include <SDL.h>
 #include <SDL_rotozoom.h>
@@ -18,12 +21,32 @@
 #include <vlc/libvlc_version.h>
 
 #include "osc_graphics.h"
+#include "worker_pool.h"
 #include "layer_video.h"
 
 Layer::CtorInfo LayerVideo::ctor_info = {"video", "s" /* url */};
 
 libvlc_instance_t *LayerVideo::vlcinst = NULL;
 
+/*
+ * Clips with media, whose decoder threads are balanced.
+ * Locked after the clips' layers.
+ */
+static Mutex decoding_mutex;
+static LIST_HEAD(decoding_head, LayerVideo) decoding_clips =
+	LIST_HEAD_INITIALIZER(decoding_clips);
+
+/*
+ * Name of libVLC's libavcodec module, prefixing its options
+ */
+#if LIBVLC_VERSION_INT < LIBVLC_VERSION(2,0,0,0)
+#define AVCODEC_MODULE "ffmpeg"
+#else
+#define AVCODEC_MODULE "avcodec"
+#endif
+
+#define DEFAULT_PRIORITY 4 /* so clips can be prioritized both ways */
+
 /*
  * libvlc callbacks
  */
@@ -35,9 +58,22 @@ static void display_cb(void *data, void *id);
 
 }
 
+class LayerVideo::ReopenJob : public WorkerPool::Job {
+public:
+	ReopenJob(LayerVideo *layer) : WorkerPool::Job(layer) {}
+
+	void
+	run()
+	{
+		((LayerVideo *)owner)->reopen();
+	}
+};
+
 LayerVideo::LayerVideo(const char *name, SDL_Rect geo, float opacity,
 		       const char *url)
-		      : Layer(name), mp(NULL), surf(NULL)
+		      : Layer(name), mp(NULL), urlv(NULL),
+			decode_threads(0), skip_loop_filter(false),
+			reopen_pending(false), surf(NULL)
 {
 	/* static initialization */
 	if (!vlcinst) {
@@ -58,22 +94,26 @@ LayerVideo::LayerVideo(const char *name, SDL_Rect geo, float opacity,
 					  (OSCServer::MethodHandlerCb)position_osc);
 	paused_osc_id = register_method("paused", "i",
 					(OSCServer::MethodHandlerCb)paused_osc);
+	priority_osc_id = register_method("priority", "i",
+					  (OSCServer::MethodHandlerCb)priority_osc);
 
 	LayerVideo::geo(geo);
 	LayerVideo::alpha(opacity);
 	LayerVideo::rate(1.);
 	LayerVideo::paused(true);
+	LayerVideo::priority(DEFAULT_PRIORITY);
 
 	LayerVideo::url(url);
+
+	store_method(rate_osc_id, ratev);
+	store_method(paused_osc_id, pausedv);
+	store_method(priority_osc_id, priorityv);
 }
 
 void
 LayerVideo::geo(SDL_Rect geo)
 {
-	if (!geo.x && !geo.y && !geo.w && !geo.h)
-		geov = (SDL_Rect){0, 0, screen->w, screen->h};
-	else
-		geov = geo;
+	geov = resolve_geo(geo);
 }
 
 #if LIBVLC_VERSION_INT < LIBVLC_VERSION(2,0,0,0)
@@ -146,28 +186,111 @@ display_cb(void *data __attribute__((unused)),
 	/* VLC wants to display the video */
 }
 
+/*
+ * Number of libavcodec threads of a clip: its share of the global
+ * decoder thread budget (config_decode_threads), weighted by priority
+ * among all clips with media.
+ * Every clip gets at least one thread, so clips with small shares may
+ * exceed the budget.
+ * Must be called with decoding_mutex locked.
+ */
+int
+LayerVideo::decode_share()
+{
+	LayerVideo *cur;
+	int weights = 0;
+	int share;
+
+	LIST_FOREACH(cur, &decoding_clips, decoding)
+		weights += cur->priorityv;
+
+	share = weights ? config_decode_threads*priorityv/weights : 0;
+	return share < 1 ? 1 : share;
+}
+
+/*
+ * Must be called with decoding_mutex locked
+ */
+bool
+LayerVideo::needs_reopen()
+{
+	return decode_threads != decode_share() ||
+	       skip_loop_filter != !priorityv;
+}
+
+/*
+ * Schedules reopening the media of clips whose share has changed.
+ * Clips are reopened by their own jobs, so the caller does not have
+ * to lock other layers.
+ * Must be called with decoding_mutex locked.
+ */
 void
-LayerVideo::url(const char *url)
+LayerVideo::rebalance()
 {
-	libvlc_media_t *m;
-	unsigned int width, height;
+	LayerVideo *cur;
 
-	SDL_FREESURFACE_SAFE(surf);
+	LIST_FOREACH(cur, &decoding_clips, decoding) {
+		if (cur->reopen_pending || !cur->needs_reopen())
+			continue;
 
-	if (mp) {
-		libvlc_media_player_release(mp);
-		mp = NULL;
+		cur->reopen_pending = true;
+		worker_pool.push(new ReopenJob(cur));
 	}
+}
 
-	if (!url || !*url)
-		return;
+void
+LayerVideo::reopen()
+{
+	bool reopen;
+
+	lock();
+
+	decoding_mutex.lock();
+	reopen_pending = false;
+	reopen = urlv && needs_reopen();
+	decoding_mutex.unlock();
+
+	if (reopen)
+		open_media();
+
+	unlock();
+}
+
+/*
+ * (Re)opens urlv with the clip's current share of decoder threads.
+ * Playback continues at the previous position.
+ */
+void
+LayerVideo::open_media()
+{
+	libvlc_media_t *m;
+	unsigned int width, height;
+	const char *chroma;
+	float position = 0.;
+	char buf[64];
+
+	if (mp)
+		position = libvlc_media_player_get_position(mp);
+	close_media();
 
 #ifdef __WIN32__
 	/* URL handling somehow broken under Windows */
-	m = libvlc_media_new_path(vlcinst, url);
+	m = libvlc_media_new_path(vlcinst, urlv);
 #else
-	m = libvlc_media_new_location(vlcinst, url);
+	m = libvlc_media_new_location(vlcinst, urlv);
 #endif
+
+	decoding_mutex.lock();
+	decode_threads = decode_share();
+	skip_loop_filter = !priorityv;
+	decoding_mutex.unlock();
+
+	snprintf(buf, sizeof(buf),
+		 ":" AVCODEC_MODULE "-threads=%d", decode_threads);
+	libvlc_media_add_option(m, buf);
+	if (skip_loop_filter)
+		libvlc_media_add_option(m, ":" AVCODEC_MODULE "-skiploopfilter=4");
+
 	mp = libvlc_media_player_new_from_media(m);
 	media_get_video_size(m, width, height);
 	libvlc_media_release(m);
@@ -178,15 +301,73 @@ LayerVideo::url(const char *url)
 	 * on our own.
 	 * We use the original video size so libVLC does not have to do
 	 * unnecessary scaling.
+	 * On 32-bit displays with the common XRGB layout, libVLC renders
+	 * in the display format directly, so blits need no conversion.
 	 */
-	surf = SDL_CreateRGBSurface(SDL_HWSURFACE, width, height,
-				    16, 0x001f, 0x07e0, 0xf800, 0);
+	if (screen->format->BitsPerPixel == 32 &&
+	    screen->format->Rmask == 0x00ff0000 &&
+	    screen->format->Gmask == 0x0000ff00 &&
+	    screen->format->Bmask == 0x000000ff) {
+		surf = SDL_CreateRGBSurface(SDL_HWSURFACE, width, height,
+					    32, 0x00ff0000, 0x0000ff00,
+					    0x000000ff, 0);
+		chroma = "RV32";
+	} else {
+		surf = SDL_CreateRGBSurface(SDL_HWSURFACE, width, height,
+					    16, 0x001f, 0x07e0, 0xf800, 0);
+		chroma = "RV16";
+	}
 
 	libvlc_video_set_callbacks(mp, lock_cb, unlock_cb, display_cb, this);
-	libvlc_video_set_format(mp, "RV16", surf->w, surf->h, surf->pitch);
+	libvlc_video_set_format(mp, chroma, surf->w, surf->h, surf->pitch);
 
 	rate(ratev);
 	paused(pausedv);
+	if (position > 0.)
+		libvlc_media_player_set_position(mp, position);
+}
+
+void
+LayerVideo::close_media()
+{
+	/* stops the decoder before its buffer is freed */
+	if (mp) {
+		libvlc_media_player_release(mp);
+		mp = NULL;
+	}
+	SDL_FREESURFACE_SAFE(surf);
+}
+
+void
+LayerVideo::url(const char *url)
+{
+	close_media();
+
+	decoding_mutex.lock();
+	if (urlv)
+		LIST_REMOVE(this, decoding);
+	free(urlv);
+	urlv = url && *url ? strdup(url) : NULL;
+	if (urlv)
+		LIST_INSERT_HEAD(&decoding_clips, this, decoding);
+	decoding_mutex.unlock();
+
+	if (urlv)
+		open_media();
+
+	decoding_mutex.lock();
+	rebalance();
+	decoding_mutex.unlock();
+}
+
+void
+LayerVideo::priority(int priority)
+{
+	decoding_mutex.lock();
+	priorityv = priority < 0 ? 0 : priority;
+	if (urlv)
+		rebalance();
+	decoding_mutex.unlock();
 }
 
 void
@@ -277,10 +458,9 @@ LayerVideo::~LayerVideo()
 	unregister_method(rate_osc_id);
 	unregister_method(position_osc_id);
 	unregister_method(paused_osc_id);
+	unregister_method(priority_osc_id);
 
-	if (mp)
-		libvlc_media_player_release(mp);
+	worker_pool.cancel(this);
+	url(NULL);
 	libvlc_release(vlcinst);
-	if (surf)
-		SDL_FreeSurface(surf);
 }
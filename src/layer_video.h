@@ -1,6 +1,8 @@
 #ifndef __LAYER_VIDEO_H
 #define __LAYER_VIDEO_H
 
+#include <bsd/sys/queue.h>
+
 #include <SDL.h>
 
 #include <lo/lo.h>
@@ -13,6 +15,18 @@
 class LayerVideo : public Layer {
 	static libvlc_instance_t *vlcinst;
 	libvlc_media_player_t *mp;
+	char *urlv;
+
+	/*
+	 * Clips with media share the decoder thread budget
+	 * (see decode_share())
+	 */
+	LIST_ENTRY(LayerVideo) decoding;
+	int decode_threads;		/* of the open media */
+	bool skip_loop_filter;		/* of the open media */
+
+	class ReopenJob;
+	bool reopen_pending;
 
 	SDL_Surface *surf;
 	Mutex mutex;
@@ -22,6 +36,7 @@ class LayerVideo : public Layer {
 
 	float ratev;
 	bool pausedv;
+	int priorityv;
 
 public:
 	LayerVideo(const char *name,
@@ -54,8 +69,20 @@ public:
 
 	void frame(SDL_Surface *target);
 
+	/* frames are decoded without locking the layer */
+	bool
+	animated()
+	{
+		return true;
+	}
+
 private:
 	void geo(SDL_Rect geo);
+	SDL_Rect
+	resolve_geo(SDL_Rect geo)
+	{
+		return resolve_null_geo(geo);
+	}
 	void alpha(float opacity);
 
 	void url(const char *url = NULL);
@@ -86,6 +113,28 @@ private:
 	{
 		obj->paused(argv[0]->i);
 	}
+
+	/*
+	 * The priority weights the clip's share of the decoder threads.
+	 * Clips with priority 0 decode with a single thread and skip the
+	 * loop filter.
+	 * Clips are reopened in the background when their share changes,
+	 * which interrupts playback briefly.
+	 */
+	void priority(int priority);
+	OSCServer::MethodHandlerId *priority_osc_id;
+	static void
+	priority_osc(LayerVideo *obj, lo_arg **argv)
+	{
+		obj->priority(argv[0]->i);
+	}
+
+	int decode_share();
+	bool needs_reopen();
+	static void rebalance();
+	void reopen();
+	void open_media();
+	void close_media();
 };
 
 #endif
@@ -5,6 +5,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_SCHED_H
+#include <sched.h>
+#endif
 
 #include <SDL.h>
 #include <SDL_framerate.h>
@@ -17,6 +25,10 @@
 
 #include "osc_graphics.h"
 #include "osc_server.h"
+#include "worker_pool.h"
+#include "image_cache.h"
+#include "font_pool.h"
+#include "surface.h"
 #include "recorder.h"
 
 #include "layer.h"
@@ -24,6 +36,14 @@
 #include "layer_text.h"
 #include "layer_image.h"
 #include "layer_video.h"
+#include "layer_tiles.h"
+#include "layer_flipbook.h"
+#include "layer_ticker.h"
+#include "layer_rects.h"
+#include "layer_vector.h"
+#include "layer_sprites.h"
+#include "layer_particles.h"
+#include "layer_group.h"
 
 /*
  * Default values
@@ -35,6 +55,12 @@
 #define DEFAULT_SHOW_CURSOR	SDL_ENABLE
 #define DEFAULT_FRAMERATE	20		/* Hz */
 #define DEFAULT_PORT		"7770"		/* port number/service/UNIX socket */
+#define DEFAULT_DECODE_THREADS	0		/* 0: all CPUs not reserved */
+#define DEFAULT_RENDER_CORES	0		/* CPU cores reserved for rendering */
+#define DEFAULT_WORKER_THREADS	2		/* background loader threads */
+#define DEFAULT_IMAGE_CACHE	256		/* MiB */
+#define DEFAULT_IDLE_TIMEOUT	0		/* s, 0: keep idle images */
+#define DEFAULT_FLATTEN_FRAMES	40		/* 0: never flatten layers */
 
 #define BOOL2STR(X) \
 	((X) ? "on" : "off")
@@ -53,10 +79,23 @@ SDL_Surface *screen;
 
 OSCServer	osc_server;
 static Recorder	recorder;
+/*
+ * must be destroyed after the layers, which may still have pending jobs
+ * and reference cached images and pooled fonts
+ */
+ImageCache	image_cache;
+FontPool	font_pool;
+WorkerPool	worker_pool;
 LayerList	layers;
 
 int config_dump_osc = 0;
 int config_framerate = DEFAULT_FRAMERATE;
+int config_decode_threads = DEFAULT_DECODE_THREADS;
+int config_render_cores = DEFAULT_RENDER_CORES;
+int config_worker_threads = DEFAULT_WORKER_THREADS;
+int config_image_cache = DEFAULT_IMAGE_CACHE;
+int config_idle_timeout = DEFAULT_IDLE_TIMEOUT;
+int config_flatten_frames = DEFAULT_FLATTEN_FRAMES;
 
 void
 rgba_blit_with_alpha(SDL_Surface *src_surf, SDL_Surface *dst_surf, Uint8 alpha)
@@ -98,6 +137,94 @@ rgba_blit_with_alpha(SDL_Surface *src_surf, SDL_Surface *dst_surf, Uint8 alpha)
 	SDL_MAYBE_UNLOCK(src_surf);
 }
 
+static inline int
+get_cpu_count(void)
+{
+#ifdef _SC_NPROCESSORS_ONLN
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (count > 0)
+		return (int)count;
+#endif
+	return 1;
+}
+
+#ifdef HAVE_SCHED_SETAFFINITY
+
+static cpu_set_t render_cpus;
+
+/*
+ * Split the CPUs available to the process into cores reserved for the
+ * render loop and cores for all other threads (OSC server, libVLC decoders).
+ * New threads inherit the affinity of the thread creating them, so the
+ * main thread is restricted to the non-reserved cores before starting any
+ * other thread and moved onto the reserved cores by affinity_render()
+ * afterwards.
+ */
+static void
+affinity_init(int cores)
+{
+	cpu_set_t all, others;
+	int n = 0;
+
+	CPU_ZERO(&render_cpus);
+
+	if (!cores)
+		return;
+
+	if (sched_getaffinity(0, sizeof(all), &all)) {
+		WARNING_MSG("sched_getaffinity: %s", strerror(errno));
+		return;
+	}
+	if (cores >= CPU_COUNT(&all)) {
+		WARNING_MSG("Cannot reserve %d of %d CPU cores for rendering",
+			    cores, CPU_COUNT(&all));
+		return;
+	}
+
+	others = all;
+	for (int cpu = 0; cpu < CPU_SETSIZE && n < cores; cpu++) {
+		if (!CPU_ISSET(cpu, &all))
+			continue;
+
+		CPU_SET(cpu, &render_cpus);
+		CPU_CLR(cpu, &others);
+		n++;
+	}
+
+	if (sched_setaffinity(0, sizeof(others), &others)) {
+		WARNING_MSG("sched_setaffinity: %s", strerror(errno));
+		CPU_ZERO(&render_cpus);
+	}
+}
+
+static void
+affinity_render(void)
+{
+	if (!CPU_COUNT(&render_cpus))
+		return;
+
+	if (sched_setaffinity(0, sizeof(render_cpus), &render_cpus))
+		WARNING_MSG("sched_setaffinity: %s", strerror(errno));
+}
+
+#else
+
+static inline void
+affinity_init(int cores)
+{
+	if (cores)
+		WARNING_MSG("Reserving CPU cores not supported on this platform");
+}
+
+static inline void
+affinity_render(void)
+{
+	/* not supported */
+}
+
+#endif
+
 static inline void
 sdl_process_events(void)
 {
@@ -147,6 +274,8 @@ print_help(void)
 	       "Usage: osc-server [-h] [-p <port>] [-f] [-c] "
 				 "[-W <width>] [-H <height>] "
 				 "[-B <bpp>] [-F <framerate>]\n"
+	       "                  [-T <threads>] [-R <cores>] [-L <threads>]\n"
+	       "                  [-M <MiB>] [-I <seconds>] [-S <frames>]\n"
 	       "Options:\n"
 	       "\t-h                 Show this help\n"
 	       "\t-p <port>          Listen on port <port> (default: %s)\n"
@@ -156,6 +285,19 @@ print_help(void)
 	       "\t-H <height>        Set screen height (default: %d)\n"
 	       "\t-B <bpp>           Set screen Bits per Pixel (default: %d)\n"
 	       "\t-F <framerate>     Set framerate in Hz (default: %d)\n"
+	       "\t-T <threads>       Set video decoder thread budget\n"
+	       "\t                   (default: all CPUs not reserved)\n"
+	       "\t-R <cores>         Reserve CPU cores for the render loop\n"
+	       "\t                   (default: %d)\n"
+	       "\t-L <threads>       Set number of background loader threads\n"
+	       "\t                   (default: %d)\n"
+	       "\t-M <MiB>           Set image cache memory budget\n"
+	       "\t                   (default: %d)\n"
+	       "\t-I <seconds>       Compress images in memory after being\n"
+	       "\t                   hidden for <seconds> (default: %d, off)\n"
+	       "\t-S <frames>        Cache the bottom layers after they have\n"
+	       "\t                   not changed for <frames> (default: %d,\n"
+	       "\t                   0: off)\n"
 	       "\n"
 	       "Homepage: <%s>\n"
 	       "E-Mail: <%s>\n",
@@ -166,13 +308,20 @@ print_help(void)
 	       DEFAULT_SCREEN_WIDTH, DEFAULT_SCREEN_HEIGHT,
 	       DEFAULT_SCREEN_BPP,
 	       DEFAULT_FRAMERATE,
+	       DEFAULT_RENDER_CORES,
+	       DEFAULT_WORKER_THREADS,
+	       DEFAULT_IMAGE_CACHE,
+	       DEFAULT_IDLE_TIMEOUT,
+	       DEFAULT_FLATTEN_FRAMES,
 	       PACKAGE_URL, PACKAGE_BUGREPORT);
 }
 
 static inline void
 parse_options(int argc, char **argv,
 	      const char *&port, Uint32 &flags, int &show_cursor,
-	      int &width, int &height, int &bpp, int &framerate)
+	      int &width, int &height, int &bpp, int &framerate,
+	      int &decode_threads, int &render_cores, int &worker_threads,
+	      int &image_cache_size, int &idle_timeout, int &flatten_frames)
 {
 	for (int i = 1; i < argc; i++) {
 		if (strlen(argv[i]) != 2 || argv[i][0] != '-')
@@ -213,6 +362,36 @@ parse_options(int argc, char **argv,
 				goto error;
 			framerate = atoi(argv[i]);
 			break;
+		case 'T':
+			if (++i == argc)
+				goto error;
+			decode_threads = atoi(argv[i]);
+			break;
+		case 'R':
+			if (++i == argc)
+				goto error;
+			render_cores = atoi(argv[i]);
+			break;
+		case 'L':
+			if (++i == argc)
+				goto error;
+			worker_threads = atoi(argv[i]);
+			break;
+		case 'M':
+			if (++i == argc)
+				goto error;
+			image_cache_size = atoi(argv[i]);
+			break;
+		case 'I':
+			if (++i == argc)
+				goto error;
+			idle_timeout = atoi(argv[i]);
+			break;
+		case 'S':
+			if (++i == argc)
+				goto error;
+			flatten_frames = atoi(argv[i]);
+			break;
 		default:
 			goto error;
 		}
@@ -244,7 +423,18 @@ main(int argc, char **argv)
 
 	parse_options(argc, argv,
 		      port, sdl_flags, show_cursor,
-		      width, height, bpp, config_framerate);
+		      width, height, bpp, config_framerate,
+		      config_decode_threads, config_render_cores,
+		      config_worker_threads, config_image_cache,
+		      config_idle_timeout, config_flatten_frames);
+
+	if (config_decode_threads <= 0) {
+		config_decode_threads = get_cpu_count() - config_render_cores;
+		if (config_decode_threads < 1)
+			config_decode_threads = 1;
+	}
+
+	affinity_init(config_render_cores);
 
 	if (SDL_Init(SDL_INIT_VIDEO)) {
 		SDL_ERROR("SDL_Init");
@@ -260,6 +450,9 @@ main(int argc, char **argv)
 		return EXIT_FAILURE;
 	}
 
+	surface_init();
+	font_pool.init();
+
 #if DEFAULT_SDL_FLAGS & SDL_HWSURFACE
 	if (!(screen->flags & SDL_HWSURFACE))
 		WARNING_MSG("Hardware surfaces not available!");
@@ -267,6 +460,11 @@ main(int argc, char **argv)
 
 	SDL_ShowCursor(show_cursor);
 
+	image_cache.set_budget((size_t)config_image_cache << 20);
+	if (config_idle_timeout > 0)
+		image_cache.set_idle_timeout(config_idle_timeout*1000);
+	worker_pool.start(config_worker_threads);
+
 	osc_server.open(port);
 
 	recorder.register_methods();
@@ -275,9 +473,20 @@ main(int argc, char **argv)
 	REGISTER_LAYER(LayerVideo);
 	REGISTER_LAYER(LayerBox);
 	REGISTER_LAYER(LayerText);
+	REGISTER_LAYER(LayerTiles);
+	REGISTER_LAYER(LayerFlipbook);
+	REGISTER_LAYER(LayerTicker);
+	REGISTER_LAYER(LayerRects);
+	REGISTER_LAYER(LayerVector);
+	REGISTER_LAYER(LayerSprites);
+	REGISTER_LAYER(LayerParticles);
+	REGISTER_LAYER(LayerGroup);
 
 	osc_server.start();
 
+	/* all other threads are started by now */
+	affinity_render();
+
 	SDL_initFramerate(&fpsm);
 	SDL_setFramerate(&fpsm, config_framerate);
 
@@ -285,6 +494,7 @@ main(int argc, char **argv)
 		sdl_process_events();
 
 		layers.render(screen);
+		image_cache.schedule_compression();
 
 		recorder.record(screen);
 
@@ -0,0 +1,134 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+#include <math.h>
+
+#include <SDL.h>
+
+#include "osc_graphics.h"
+#include "osc_server.h"
+#include "modulator.h"
+
+/*
+ * Seconds since a point in time set by the OSC thread, which may lie
+ * after the ticks of the frame being advanced
+ */
+static inline float
+seconds_since(Uint32 ticks, Uint32 since)
+{
+	Sint32 elapsed = (Sint32)(ticks - since);
+
+	return elapsed > 0 ? elapsed/1000. : 0.;
+}
+
+ModulatorLFO::ModulatorLFO(OSCServer::LayerMethod *method, int index,
+			   Shape _shape, float _frequency,
+			   float _center, float _depth, float _phase) :
+			  Modulator(method, index),
+			  shape(_shape), frequency(_frequency),
+			  center(_center), depth(_depth), phase(_phase),
+			  start(SDL_GetTicks()),
+			  random_state(0x2545F491 ^ start),
+			  random_cycle(-1), random_value(0.) {}
+
+bool
+ModulatorLFO::parse_shape(const char *name, Shape &shape)
+{
+	static const char *names[] = {
+		"sine", "triangle", "saw", "square", "random"
+	};
+
+	for (unsigned int i = 0; i < NARRAY(names); i++) {
+		if (!strcmp(name, names[i])) {
+			shape = (Shape)i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+float
+ModulatorLFO::value(Uint32 ticks)
+{
+	float cycles = phase + frequency*seconds_since(ticks, start);
+	float p = cycles - floorf(cycles);
+	float wave;
+
+	switch (shape) {
+	case SHAPE_SINE:
+		wave = sinf(2*(float)M_PI*p);
+		break;
+	case SHAPE_TRIANGLE:
+		wave = 1. - 4.*fabsf(p - .5);
+		break;
+	case SHAPE_SAW:
+		wave = 2.*p - 1.;
+		break;
+	case SHAPE_SQUARE:
+		wave = p < .5 ? 1. : -1.;
+		break;
+	case SHAPE_RANDOM:
+		/* new value (xorshift) once per cycle */
+		if ((int)floorf(cycles) != random_cycle) {
+			random_cycle = (int)floorf(cycles);
+			random_state ^= random_state << 13;
+			random_state ^= random_state >> 17;
+			random_state ^= random_state << 5;
+			random_value = (random_state >> 8)/8388608. - 1.;
+		}
+		wave = random_value;
+		break;
+	default:
+		wave = 0.;
+		break;
+	}
+
+	return center + depth*wave;
+}
+
+ModulatorEnvelope::ModulatorEnvelope(OSCServer::LayerMethod *method,
+				     int index,
+				     float _attack, float _decay,
+				     float _sustain, float _release,
+				     float _low, float _high) :
+				    Modulator(method, index),
+				    attack(_attack), decay(_decay),
+				    sustain(_sustain), release(_release),
+				    low(_low), high(_high),
+				    gate_on(false), gate_ticks(SDL_GetTicks()),
+				    gate_level(0.) {}
+
+float
+ModulatorEnvelope::level(Uint32 ticks)
+{
+	float t = seconds_since(ticks, gate_ticks);
+
+	if (!gate_on)
+		return t < release ? gate_level*(1. - t/release) : 0.;
+
+	/* attack continues from the current level when retriggered */
+	if (t < attack)
+		return gate_level + (1. - gate_level)*t/attack;
+	t -= attack;
+	if (t < decay)
+		return 1. - (1. - sustain)*t/decay;
+
+	return sustain;
+}
+
+float
+ModulatorEnvelope::value(Uint32 ticks)
+{
+	return low + (high - low)*level(ticks);
+}
+
+void
+ModulatorEnvelope::gate(bool on, Uint32 ticks)
+{
+	gate_level = level(ticks);
+	gate_on = on;
+	gate_ticks = ticks;
+}
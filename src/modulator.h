@@ -0,0 +1,96 @@
+#ifndef __MODULATOR_H
+#define __MODULATOR_H
+
+#include <bsd/sys/queue.h>
+
+#include <SDL.h>
+
+#include "osc_server.h"
+
+/* upper bound for the number of arguments of modulated methods */
+#define MODULATOR_MAX_ARGS 16
+
+/*
+ * Continuous source for one numeric argument of a layer method.
+ * Modulators are evaluated by the render loop, so clients do not have
+ * to stream parameter changes.
+ */
+class Modulator {
+public:
+	TAILQ_ENTRY(Modulator) modulators;
+
+	OSCServer::LayerMethod	*method;
+	int			index;		/* of the method argument */
+
+	lo_arg			output;		/* last value passed */
+	bool			applied;	/* output is valid */
+
+	Modulator(OSCServer::LayerMethod *_method, int _index) :
+		 method(_method), index(_index), applied(false) {}
+	virtual ~Modulator() {}
+
+	virtual float value(Uint32 ticks) = 0;
+	virtual void gate(bool on __attribute__((unused)),
+			  Uint32 ticks __attribute__((unused))) {}
+};
+
+/*
+ * Low frequency oscillator: center + depth*wave
+ */
+class ModulatorLFO : public Modulator {
+public:
+	enum Shape {
+		SHAPE_SINE = 0,
+		SHAPE_TRIANGLE,
+		SHAPE_SAW,
+		SHAPE_SQUARE,
+		SHAPE_RANDOM
+	};
+
+private:
+	Shape	shape;
+	float	frequency;	/* Hz */
+	float	center, depth;
+	float	phase;		/* 0 to 1 */
+	Uint32	start;		/* ticks */
+
+	/* sample and hold */
+	Uint32	random_state;
+	int	random_cycle;
+	float	random_value;
+
+public:
+	ModulatorLFO(OSCServer::LayerMethod *method, int index,
+		     Shape shape, float frequency,
+		     float center, float depth, float phase);
+
+	static bool parse_shape(const char *name, Shape &shape);
+
+	float value(Uint32 ticks);
+};
+
+/*
+ * ADSR envelope between low and high, triggered by gate()
+ */
+class ModulatorEnvelope : public Modulator {
+	float	attack, decay;	/* seconds */
+	float	sustain;	/* level, 0 to 1 */
+	float	release;	/* seconds */
+	float	low, high;
+
+	bool	gate_on;
+	Uint32	gate_ticks;
+	float	gate_level;	/* level when the gate changed */
+
+	float level(Uint32 ticks);
+
+public:
+	ModulatorEnvelope(OSCServer::LayerMethod *method, int index,
+			  float attack, float decay, float sustain,
+			  float release, float low, float high);
+
+	float value(Uint32 ticks);
+	void gate(bool on, Uint32 ticks);
+};
+
+#endif
@@ -7,6 +7,8 @@
 #include <SDL_thread.h>
 
 class Mutex {
+	friend class Cond;
+
 	SDL_mutex *mutex;
 
 public:
@@ -28,6 +30,34 @@ public:
 	}
 };
 
+class Cond {
+	SDL_cond *cond;
+
+public:
+	Cond() : cond(SDL_CreateCond()) {}
+	~Cond()
+	{
+		SDL_DestroyCond(cond);
+	}
+
+	/* mutex must be locked */
+	inline void
+	wait(Mutex &mutex)
+	{
+		SDL_CondWait(cond, mutex.mutex);
+	}
+	inline void
+	signal()
+	{
+		SDL_CondSignal(cond);
+	}
+	inline void
+	broadcast()
+	{
+		SDL_CondBroadcast(cond);
+	}
+};
+
 #include "osc_server.h"
 #include "layer.h"
 
@@ -74,6 +104,12 @@ extern SDL_Surface *screen;
 
 extern int config_dump_osc;
 extern int config_framerate;
+extern int config_decode_threads;
+extern int config_render_cores;
+extern int config_worker_threads;
+extern int config_image_cache;
+extern int config_idle_timeout;
+extern int config_flatten_frames;
 
 #define FRAME_DELAY \
 	(1000/config_framerate) /* frame delay in ms */
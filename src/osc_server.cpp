@@ -4,6 +4,8 @@
 
 #include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <SDL.h>
 
@@ -110,7 +112,7 @@ dtor_generic_handler(const char *path,
 {
 	Layer *layer = (Layer *)user_data;
 
-	layers.delete_layer(layer);
+	layer->list->delete_layer(layer);
 	osc_server.del_method("", "%s", path);
 
 	return 0;
@@ -132,6 +134,7 @@ ctor_generic_handler(const char *path __attribute__((unused)),
 	};
 
 	layer = const_cb(&argv[1]->s, geo, argv[6]->f, argv + 7);
+	layer->defaults(geo, argv[6]->f);
 	layers.insert(argv[0]->i, layer);
 
 	osc_server.add_method("", dtor_generic_handler, layer,
@@ -151,10 +154,63 @@ OSCServer::register_layer(const char *name, const char *types,
 		   "/layer/new/%s", name);
 }
 
-struct OscMethodDefaultCtx {
-	Layer				*layer;
-	OSCServer::MethodHandlerCb	method_cb;
-};
+OSCServer::LayerMethod::LayerMethod(Layer *_layer, const char *_name,
+				    const char *_types,
+				    MethodHandlerCb _method_cb) :
+				   layer(_layer), name(strdup(_name)),
+				   types(strdup(_types)),
+				   method_cb(_method_cb), args(NULL),
+				   stored(false), called(false)
+{
+	int argc = strlen(types);
+
+	if (!argc || strspn(types, "if") != (size_t)argc)
+		return;
+
+	/* arguments are unknown until stored */
+	args = (lo_arg *)calloc(argc, sizeof(lo_arg));
+}
+
+OSCServer::LayerMethod::~LayerMethod()
+{
+	free(args);
+	free(types);
+	free(name);
+}
+
+void
+OSCServer::LayerMethod::store(lo_arg **argv)
+{
+	if (!args)
+		return;
+
+	for (int i = 0; types[i]; i++) {
+		if (types[i] == 'i')
+			args[i].i = argv[i]->i;
+		else
+			args[i].f = argv[i]->f;
+	}
+	stored = true;
+	called = true;
+}
+
+/*
+ * Stores arguments passed as ints and doubles
+ */
+void
+OSCServer::LayerMethod::store_v(va_list ap)
+{
+	if (!args)
+		return;
+
+	for (int i = 0; types[i]; i++) {
+		if (types[i] == 'i')
+			args[i].i = va_arg(ap, int);
+		else
+			args[i].f = (float)va_arg(ap, double);
+	}
+	stored = true;
+}
 
 static int
 method_generic_handler(const char *path __attribute__((unused)),
@@ -163,9 +219,10 @@ method_generic_handler(const char *path __attribute__((unused)),
 		       void *data __attribute__((unused)),
 		       void *user_data)
 {
-	OscMethodDefaultCtx *ctx = (OscMethodDefaultCtx *)user_data;
+	OSCServer::LayerMethod *ctx = (OSCServer::LayerMethod *)user_data;
 
 	ctx->layer->lock();
+	ctx->store(argv);
 	ctx->method_cb(ctx->layer, argv);
 	ctx->layer->unlock();
 
@@ -177,10 +234,9 @@ OSCServer::register_method(Layer *layer, const char *method, const char *types,
 			   MethodHandlerCb method_cb)
 {
 	MethodHandlerId *hnd;
-	OscMethodDefaultCtx *ctx = new OscMethodDefaultCtx;
+	LayerMethod *ctx = new LayerMethod(layer, method, types, method_cb);
 
-	ctx->layer = layer;
-	ctx->method_cb = method_cb;
+	SLIST_INSERT_HEAD(&layer->methods, ctx, methods);
 
 	add_method(&hnd, types, method_generic_handler, ctx,
 		   "/layer/%s/%s", layer->name, method);
@@ -191,7 +247,10 @@ OSCServer::register_method(Layer *layer, const char *method, const char *types,
 void
 OSCServer::unregister_method(MethodHandlerId *hnd)
 {
-	delete (OscMethodDefaultCtx *)hnd->data;
+	LayerMethod *ctx = (LayerMethod *)hnd->data;
+
+	SLIST_REMOVE(&ctx->layer->methods, ctx, LayerMethod, methods);
+	delete ctx;
 	del_method(hnd);
 }
 
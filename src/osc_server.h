@@ -3,6 +3,7 @@
 
 #include <string.h>
 #include <stdarg.h>
+#include <bsd/sys/queue.h>
 
 #include <SDL.h>
 
@@ -43,6 +44,33 @@ public:
 	typedef Layer *(*CtorHandlerCb)(const char *name, SDL_Rect geo,
 					float alpha, lo_arg **argv);
 
+	/*
+	 * Methods registered by layers.
+	 * The last arguments of methods with only numeric arguments
+	 * are remembered, so they can be called again with some of them
+	 * replaced (see Modulator).
+	 */
+	struct LayerMethod {
+		SLIST_ENTRY(LayerMethod) methods;
+
+		Layer		*layer;
+		char		*name;
+		char		*types;
+		MethodHandlerCb	method_cb;
+
+		lo_arg		*args;		/* NULL if not numeric */
+		bool		stored;		/* args are valid */
+		bool		called;		/* by a client since the last
+						   modulation */
+
+		LayerMethod(Layer *layer, const char *name, const char *types,
+			    MethodHandlerCb method_cb);
+		~LayerMethod();
+
+		void store(lo_arg **argv);
+		void store_v(va_list ap);
+	};
+
 	OSCServer() : server(NULL) {}
 	~OSCServer();
 
@@ -105,4 +133,6 @@ public:
 
 #define COLOR_TYPES	"iii"			/* r, g, b */
 
+#define TWEEN_TYPES	"fs"			/* duration, easing */
+
 #endif
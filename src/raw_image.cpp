@@ -0,0 +1,210 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <SDL.h>
+
+#include "osc_graphics.h"
+#include "raw_image.h"
+
+static bool
+header_is_valid(const RawImageHeader *header, size_t file_size)
+{
+	if (memcmp(header->magic, RAW_IMAGE_MAGIC, sizeof(header->magic)) ||
+	    header->byteorder != RAW_IMAGE_BYTEORDER)
+		return false;
+
+	if (header->bpp != 16 && header->bpp != 24 && header->bpp != 32)
+		return false;
+
+	return header->width && header->height &&
+	       header->pitch >= header->width*(header->bpp/8) &&
+	       header->offset >= sizeof(RawImageHeader) &&
+	       header->offset + (size_t)header->pitch*header->height <= file_size;
+}
+
+#ifdef HAVE_SYS_MMAN_H
+
+/*
+ * Load raw image by mapping it into memory.
+ * The surface's pixels point into the mapping, which must be unmapped
+ * using raw_image_unmap() after freeing the surface.
+ * Returns NULL if path is not a valid raw image.
+ */
+SDL_Surface *
+raw_image_load(const char *path, void **map, size_t *map_size)
+{
+	RawImageHeader header;
+	struct stat st;
+	SDL_Surface *surf;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) ||
+	    read(fd, &header, sizeof(header)) != sizeof(header) ||
+	    !header_is_valid(&header, st.st_size)) {
+		close(fd);
+		return NULL;
+	}
+
+	/*
+	 * Private writable mapping: pages are shared with the page cache
+	 * unless something writes to them
+	 */
+	*map_size = st.st_size;
+	*map = mmap(NULL, *map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+		    fd, 0);
+	close(fd);
+	if (*map == MAP_FAILED) {
+		ERROR_MSG("mmap(\"%s\"): %s", path, strerror(errno));
+		return NULL;
+	}
+
+	surf = SDL_CreateRGBSurfaceFrom((Uint8 *)*map + header.offset,
+					header.width, header.height,
+					header.bpp, header.pitch,
+					header.Rmask, header.Gmask,
+					header.Bmask, header.Amask);
+	if (!surf) {
+		SDL_ERROR("SDL_CreateRGBSurfaceFrom");
+		munmap(*map, *map_size);
+		return NULL;
+	}
+
+	return surf;
+}
+
+void
+raw_image_unmap(void *map, size_t map_size)
+{
+	if (map)
+		munmap(map, map_size);
+}
+
+#else /* !HAVE_SYS_MMAN_H */
+
+/*
+ * Without mmap(), the pixel data is read into an ordinary surface
+ */
+SDL_Surface *
+raw_image_load(const char *path, void **map, size_t *map_size)
+{
+	RawImageHeader header;
+	SDL_Surface *surf;
+	FILE *file;
+	long file_size;
+
+	*map = NULL;
+	*map_size = 0;
+
+	file = fopen(path, "rb");
+	if (!file)
+		return NULL;
+
+	if (fseek(file, 0, SEEK_END) || (file_size = ftell(file)) < 0 ||
+	    fseek(file, 0, SEEK_SET) ||
+	    fread(&header, sizeof(header), 1, file) != 1 ||
+	    !header_is_valid(&header, file_size) ||
+	    fseek(file, header.offset, SEEK_SET)) {
+		fclose(file);
+		return NULL;
+	}
+
+	surf = SDL_CreateRGBSurface(SDL_SWSURFACE,
+				    header.width, header.height, header.bpp,
+				    header.Rmask, header.Gmask,
+				    header.Bmask, header.Amask);
+	if (!surf) {
+		SDL_ERROR("SDL_CreateRGBSurface");
+		fclose(file);
+		return NULL;
+	}
+
+	for (Uint32 y = 0; y < header.height; y++) {
+		Uint8 *row = (Uint8 *)surf->pixels + y*surf->pitch;
+
+		if (fread(row, surf->w*(header.bpp/8), 1, file) != 1 ||
+		    fseek(file, header.pitch - surf->w*(header.bpp/8),
+			  SEEK_CUR)) {
+			ERROR_MSG("Error reading \"%s\"", path);
+			SDL_FreeSurface(surf);
+			fclose(file);
+			return NULL;
+		}
+	}
+
+	fclose(file);
+	return surf;
+}
+
+void
+raw_image_unmap(void *map __attribute__((unused)),
+		size_t map_size __attribute__((unused)))
+{
+	/* nothing mapped */
+}
+
+#endif
+
+int
+raw_image_save(SDL_Surface *surf, const char *path)
+{
+	RawImageHeader header;
+	static const Uint8 padding[RAW_IMAGE_DATA_OFFSET] = {0};
+	SDL_PixelFormat *fmt = surf->format;
+	FILE *file;
+	int ret = 0;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, RAW_IMAGE_MAGIC, sizeof(header.magic));
+	header.byteorder = RAW_IMAGE_BYTEORDER;
+	header.width = surf->w;
+	header.height = surf->h;
+	header.pitch = surf->pitch;
+	header.bpp = fmt->BitsPerPixel;
+	header.Rmask = fmt->Rmask;
+	header.Gmask = fmt->Gmask;
+	header.Bmask = fmt->Bmask;
+	header.Amask = fmt->Amask;
+	header.offset = RAW_IMAGE_DATA_OFFSET;
+
+	file = fopen(path, "wb");
+	if (!file) {
+		ERROR_MSG("fopen(\"%s\"): %s", path, strerror(errno));
+		return -1;
+	}
+
+	SDL_MAYBE_LOCK(surf);
+
+	if (fwrite(&header, sizeof(header), 1, file) != 1 ||
+	    fwrite(padding, RAW_IMAGE_DATA_OFFSET - sizeof(header),
+		   1, file) != 1 ||
+	    fwrite(surf->pixels, surf->pitch, surf->h, file) != (size_t)surf->h) {
+		ERROR_MSG("Error writing \"%s\": %s", path, strerror(errno));
+		ret = -1;
+	}
+
+	SDL_MAYBE_UNLOCK(surf);
+
+	if (fclose(file) && !ret) {
+		ERROR_MSG("Error writing \"%s\": %s", path, strerror(errno));
+		ret = -1;
+	}
+
+	return ret;
+}
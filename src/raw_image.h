@@ -0,0 +1,35 @@
+#ifndef __RAW_IMAGE_H
+#define __RAW_IMAGE_H
+
+#include <stddef.h>
+
+#include <SDL.h>
+
+/*
+ * Raw image container: a header followed by uncompressed pixel data
+ * in a display pixel format, so images can be memory-mapped and blitted
+ * without decoding or copying.
+ * All header fields are in host byte order.
+ */
+#define RAW_IMAGE_MAGIC		"OSCGRAW1"
+#define RAW_IMAGE_BYTEORDER	0x01020304
+#define RAW_IMAGE_DATA_OFFSET	64	/* keeps pixel data aligned */
+
+struct RawImageHeader {
+	char	magic[8];
+	Uint32	byteorder;
+
+	Uint32	width, height;
+	Uint32	pitch;			/* bytes per row */
+	Uint32	bpp;			/* bits per pixel */
+	Uint32	Rmask, Gmask, Bmask, Amask;
+
+	Uint32	offset;			/* of pixel data in file */
+};
+
+SDL_Surface *raw_image_load(const char *path, void **map, size_t *map_size);
+void raw_image_unmap(void *map, size_t map_size);
+
+int raw_image_save(SDL_Surface *surf, const char *path);
+
+#endif
@@ -0,0 +1,255 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+
+#include "osc_graphics.h"
+#include "worker_pool.h"
+#include "image_cache.h"
+#include "surface.h"
+#include "layer.h"
+#include "sprite_batch.h"
+
+class SpriteAtlas::LoadJob : public WorkerPool::Job {
+	SpriteAtlas *atlas;
+
+public:
+	LoadJob(SpriteAtlas *_atlas) :
+	       WorkerPool::Job(_atlas->layer), atlas(_atlas) {}
+
+	void
+	run()
+	{
+		atlas->load();
+	}
+};
+
+/*
+ * Cells are surfaces referring to the atlas' pixels, so they can be
+ * composited individually without copying them.
+ * The colorkey of the atlas is preserved.
+ * Returns an array of cols*rows cells or NULL.
+ */
+SDL_Surface **
+sprite_cells_new(SDL_Surface *sheet, int cols, int rows)
+{
+	int cell_w = sheet->w/cols;
+	int cell_h = sheet->h/rows;
+	SDL_Surface **cells;
+
+	if (!cell_w || !cell_h)
+		return NULL;
+
+	cells = (SDL_Surface **)calloc(cols*rows, sizeof(SDL_Surface *));
+
+	for (int row = 0; row < rows; row++) {
+		for (int col = 0; col < cols; col++) {
+			SDL_Surface *cell;
+
+			cell = SDL_CreateRGBSurfaceFrom(
+				(Uint8 *)sheet->pixels + row*cell_h*sheet->pitch +
+					col*cell_w*sheet->format->BytesPerPixel,
+				cell_w, cell_h,
+				sheet->format->BitsPerPixel, sheet->pitch,
+				sheet->format->Rmask, sheet->format->Gmask,
+				sheet->format->Bmask, sheet->format->Amask);
+			if (!cell) {
+				SDL_ERROR("SDL_CreateRGBSurfaceFrom");
+				sprite_cells_free(cells, cols*rows);
+				return NULL;
+			}
+			if (sheet->flags & SDL_SRCCOLORKEY)
+				SDL_SetColorKey(cell, SDL_SRCCOLORKEY,
+						sheet->format->colorkey);
+
+			cells[row*cols + col] = cell;
+		}
+	}
+
+	return cells;
+}
+
+void
+sprite_cells_free(SDL_Surface **cells, int num_cells)
+{
+	if (!cells)
+		return;
+
+	for (int i = 0; i < num_cells; i++)
+		if (cells[i])
+			SDL_FreeSurface(cells[i]);
+	free(cells);
+}
+
+SpriteAtlas::SpriteAtlas(Layer *_layer) :
+			 layer(_layer), sheet(NULL), filev(NULL),
+			 cols(1), rows(1),
+			 pending_file(NULL), load_pending(false),
+			 cells(NULL), num_cells(0) {}
+
+void
+SpriteAtlas::file(const char *file)
+{
+	free(pending_file);
+	pending_file = strdup(file);
+
+	if (load_pending)
+		return;
+
+	load_pending = true;
+	worker_pool.push(new LoadJob(this));
+}
+
+void
+SpriteAtlas::grid(int cols, int rows)
+{
+	if (cols < 1 || rows < 1) {
+		WARNING_MSG("Invalid sprite grid %dx%d", cols, rows);
+		return;
+	}
+
+	SpriteAtlas::cols = cols;
+	SpriteAtlas::rows = rows;
+	update_cells();
+}
+
+void
+SpriteAtlas::update_cells()
+{
+	sprite_cells_free(cells, num_cells);
+	cells = sheet ? sprite_cells_new(sheet, cols, rows) : NULL;
+	num_cells = cells ? cols*rows : 0;
+}
+
+/*
+ * Loads pending files via the image cache.
+ * Runs in a worker thread until no file is pending.
+ */
+void
+SpriteAtlas::load()
+{
+	layer->lock();
+
+	while (pending_file) {
+		char *new_file = pending_file;
+		SDL_Surface *new_sheet = NULL;
+
+		pending_file = NULL;
+		layer->unlock();
+
+		if (*new_file)
+			new_sheet = image_cache.get(new_file);
+
+		layer->lock();
+
+		if (*new_file && !new_sheet) {
+			/* keep displaying the old atlas */
+			free(new_file);
+			continue;
+		}
+
+		if (sheet)
+			image_cache.release(sheet);
+		free(filev);
+
+		sheet = new_sheet;
+		filev = new_file;
+		update_cells();
+	}
+
+	load_pending = false;
+	layer->unlock();
+}
+
+SpriteAtlas::~SpriteAtlas()
+{
+	free(pending_file);
+	free(filev);
+
+	sprite_cells_free(cells, num_cells);
+	if (sheet)
+		image_cache.release(sheet);
+}
+
+/*
+ * Composites instances of atlas cells (of identical size) in a single
+ * loop, culled against and clipped to geo.
+ * Unscaled opaque instances are blitted by SDL, others are scaled and
+ * blended by surface_blit_scaled().
+ * Cells surface_blit_scaled() does not support (e.g. colorkeyed ones)
+ * are always blitted by SDL, ignoring scales. Opacities are then only
+ * supported for cells without alpha channel.
+ */
+void
+sprite_batch_draw(SDL_Surface *target, SDL_Rect geo,
+		  SDL_Surface **cells, int num_cells,
+		  const SpriteInstance *instances, int num_instances,
+		  Uint8 opacity)
+{
+	const SDL_Rect &clip = target->clip_rect;
+	SDL_Rect old_clip;
+	bool can_scale;
+	int cell_w, cell_h;
+
+	if (!opacity || !num_cells || !num_instances)
+		return;
+
+	can_scale = surface_can_blit_scaled(cells[0], target);
+	cell_w = cells[0]->w;
+	cell_h = cells[0]->h;
+
+	SDL_GetClipRect(target, &old_clip);
+	SDL_SetClipRect(target, &geo);
+
+	for (const SpriteInstance *inst = instances,
+				  *end = instances + num_instances;
+	     inst < end; inst++) {
+		Uint8 alpha;
+		int x, y, w, h;
+
+		if (!inst->alpha || !inst->scale || inst->cell >= num_cells)
+			continue;
+
+		if (can_scale) {
+			w = (cell_w*inst->scale) >> 8;
+			h = (cell_h*inst->scale) >> 8;
+		} else {
+			w = cell_w;
+			h = cell_h;
+		}
+		x = geo.x + inst->x - w/2;
+		y = geo.y + inst->y - h/2;
+
+		/* culling */
+		if (x >= clip.x + clip.w || y >= clip.y + clip.h ||
+		    x + w <= clip.x || y + h <= clip.y || !w || !h)
+			continue;
+
+		alpha = (Uint8)((inst->alpha*opacity + 127)/SDL_ALPHA_OPAQUE);
+		if (!alpha)
+			continue;
+
+		if (can_scale && (inst->scale != SPRITE_SCALE_ONE ||
+				  alpha < SDL_ALPHA_OPAQUE)) {
+			surface_blit_scaled(cells[inst->cell], target,
+					    x*0x10000, y*0x10000, w, h, alpha);
+		} else {
+			SDL_Surface *cell = cells[inst->cell];
+			SDL_Rect dst_rect = {(Sint16)x, (Sint16)y};
+
+			if (!cell->format->Amask) {
+				if (alpha == SDL_ALPHA_OPAQUE)
+					SDL_SetAlpha(cell, 0, 0);
+				else
+					SDL_SetAlpha(cell, SDL_SRCALPHA, alpha);
+			}
+			SDL_BlitSurface(cell, NULL, target, &dst_rect);
+		}
+	}
+
+	SDL_SetClipRect(target, &old_clip);
+}
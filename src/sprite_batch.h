@@ -0,0 +1,82 @@
+#ifndef __SPRITE_BATCH_H
+#define __SPRITE_BATCH_H
+
+#include <SDL.h>
+
+/*
+ * Instance of an atlas cell
+ */
+struct SpriteInstance {
+	Sint16	x, y;		/* center */
+	Uint16	scale;		/* 8.8 fixed point */
+	Uint16	cell;
+	Uint8	alpha;
+};
+
+#define SPRITE_SCALE_ONE 0x100
+
+/*
+ * Conversions to instance fields, saturating instead of wrapping
+ */
+static inline Sint16
+sprite_coord(float coord)
+{
+	if (coord <= -32768.)
+		return -32768;
+	return coord < 32767. ? (Sint16)coord : 32767;
+}
+
+static inline Uint16
+sprite_scale(float scale)
+{
+	scale *= SPRITE_SCALE_ONE;
+	if (scale <= 0.)
+		return 0;
+	return scale < 65535. ? (Uint16)scale : 65535;
+}
+
+class Layer;
+
+/*
+ * Atlas image of a layer, split into a grid of cells.
+ * Images are loaded via the image cache by a background job owned by
+ * the layer, so the layer must cancel its jobs before the atlas is
+ * destroyed. The current cells are only replaced when the job has
+ * finished, with the layer locked.
+ */
+class SpriteAtlas {
+	class LoadJob;
+
+	Layer		*layer;
+	SDL_Surface	*sheet;		/* from image cache */
+	char		*filev;
+	int		cols, rows;
+
+	char		*pending_file;	/* file to load or NULL */
+	bool		load_pending;	/* load job queued or running */
+
+	void update_cells();
+	void load();
+
+public:
+	/* views of the atlas cells, sharing its pixels */
+	SDL_Surface	**cells;
+	int		num_cells;
+
+	SpriteAtlas(Layer *layer);
+	~SpriteAtlas();
+
+	/* must be called with the layer locked */
+	void file(const char *file);
+	void grid(int cols, int rows);
+};
+
+SDL_Surface **sprite_cells_new(SDL_Surface *sheet, int cols, int rows);
+void sprite_cells_free(SDL_Surface **cells, int num_cells);
+
+void sprite_batch_draw(SDL_Surface *target, SDL_Rect geo,
+		       SDL_Surface **cells, int num_cells,
+		       const SpriteInstance *instances, int num_instances,
+		       Uint8 opacity = SDL_ALPHA_OPAQUE);
+
+#endif
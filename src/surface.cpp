@@ -0,0 +1,557 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+
+#include "osc_graphics.h"
+#include "surface.h"
+
+/*
+ * Macros
+ */
+#define RB_MASK	0x00FF00FF	/* red and blue channels */
+#define G_MASK	0x0000FF00
+
+#ifndef MIN
+#define MIN(A, B) ((A) < (B) ? (A) : (B))
+#endif
+#ifndef MAX
+#define MAX(A, B) ((A) > (B) ? (A) : (B))
+#endif
+
+/*
+ * Surface having the pixel format SDL_DisplayFormatAlpha() would
+ * convert to
+ */
+static SDL_Surface *alpha_format_surf = NULL;
+
+/*
+ * Must be called after the video mode has been set
+ */
+void
+surface_init(void)
+{
+	SDL_PixelFormat *vf = screen->format;
+	Uint32 Rmask = 0x00FF0000;
+	Uint32 Bmask = 0x000000FF;
+
+	/* same rules as SDL_DisplayFormatAlpha() */
+	switch (vf->BytesPerPixel) {
+	case 2:
+		if (vf->Rmask == 0x1F &&
+		    (vf->Bmask == 0xF800 || vf->Bmask == 0x7C00)) {
+			Rmask = 0x000000FF;
+			Bmask = 0x00FF0000;
+		}
+		break;
+	case 3:
+	case 4:
+		if (vf->Rmask == 0xFF && vf->Bmask == 0xFF0000) {
+			Rmask = 0x000000FF;
+			Bmask = 0x00FF0000;
+		}
+		break;
+	}
+
+	alpha_format_surf = SDL_CreateRGBSurface(SDL_SWSURFACE, 1, 1, 32,
+						 Rmask, 0x0000FF00, Bmask,
+						 0xFF000000);
+	if (!alpha_format_surf) {
+		SDL_ERROR("SDL_CreateRGBSurface");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static inline SDL_PixelFormat *
+get_display_format(SDL_Surface *surf)
+{
+	return surf->format->Amask ? alpha_format_surf->format
+				   : screen->format;
+}
+
+bool
+surface_is_display_format(SDL_Surface *surf)
+{
+	SDL_PixelFormat *fmt = get_display_format(surf);
+
+	return surf->format->BitsPerPixel == fmt->BitsPerPixel &&
+	       surf->format->Rmask == fmt->Rmask &&
+	       surf->format->Gmask == fmt->Gmask &&
+	       surf->format->Bmask == fmt->Bmask &&
+	       surf->format->Amask == fmt->Amask;
+}
+
+/*
+ * Convert surface to the display format (with or without alpha channel),
+ * so blitting it to the screen does not require pixel format conversions.
+ * Unlike SDL_DisplayFormat(), this always creates software surfaces
+ * and may be called from any thread.
+ * Frees surf, unless conversion is unnecessary or fails, in which
+ * case surf is returned.
+ */
+SDL_Surface *
+surface_display_format(SDL_Surface *surf)
+{
+	SDL_Surface *new_surf;
+	Uint32 flags;
+
+	if (surface_is_display_format(surf))
+		return surf;
+
+	flags = SDL_SWSURFACE | (surf->flags & (SDL_SRCCOLORKEY | SDL_SRCALPHA));
+	if (surf->format->Amask)
+		flags |= SDL_SRCALPHA;
+
+	new_surf = SDL_ConvertSurface(surf, get_display_format(surf), flags);
+	if (!new_surf) {
+		SDL_ERROR("SDL_ConvertSurface");
+		return surf;
+	}
+
+	SDL_FreeSurface(surf);
+	return new_surf;
+}
+
+/*
+ * Create a surface in the display format with alpha channel
+ */
+SDL_Surface *
+surface_new_alpha(int w, int h)
+{
+	SDL_PixelFormat *fmt = alpha_format_surf->format;
+	SDL_Surface *surf;
+
+	surf = SDL_CreateRGBSurface(SDL_SWSURFACE | SDL_SRCALPHA, w, h, 32,
+				    fmt->Rmask, fmt->Gmask, fmt->Bmask,
+				    fmt->Amask);
+	if (!surf)
+		SDL_ERROR("SDL_CreateRGBSurface");
+
+	return surf;
+}
+
+/*
+ * Run-length encoding of surface pixels, used to keep idle images in
+ * memory. Every row is encoded separately into packets with a one byte
+ * header: Headers below 0x80 are followed by header+1 literal pixels,
+ * other headers by one pixel repeated header-0x80+2 times.
+ * Decoding is little more than a memcpy() of the image.
+ */
+#define RLE_MAX_LITERAL	0x80
+#define RLE_MAX_RUN	(0xFF - 0x80 + 2)
+
+template <typename Pixel>
+static Uint8 *
+rle_encode_row(const Pixel *src, int w, Uint8 *dst)
+{
+	int x = 0;
+
+	while (x < w) {
+		int run = 1;
+
+		while (x + run < w && run < RLE_MAX_RUN &&
+		       src[x + run] == src[x])
+			run++;
+
+		if (run > 1) {
+			*dst++ = (Uint8)(0x80 + run - 2);
+			memcpy(dst, src + x, sizeof(Pixel));
+			dst += sizeof(Pixel);
+			x += run;
+		} else {
+			int lit = 1;
+
+			/* up to the next run of at least two pixels */
+			while (x + lit < w && lit < RLE_MAX_LITERAL &&
+			       (x + lit + 1 >= w ||
+				src[x + lit] != src[x + lit + 1]))
+				lit++;
+
+			*dst++ = (Uint8)(lit - 1);
+			memcpy(dst, src + x, lit*sizeof(Pixel));
+			dst += lit*sizeof(Pixel);
+			x += lit;
+		}
+	}
+
+	return dst;
+}
+
+template <typename Pixel>
+static const Uint8 *
+rle_decode_row(const Uint8 *src, Pixel *dst, int w)
+{
+	int x = 0;
+
+	while (x < w) {
+		Uint8 hdr = *src++;
+
+		if (hdr < 0x80) {
+			int lit = hdr + 1;
+
+			memcpy(dst + x, src, lit*sizeof(Pixel));
+			src += lit*sizeof(Pixel);
+			x += lit;
+		} else {
+			int run = hdr - 0x80 + 2;
+			Pixel pixel;
+
+			memcpy(&pixel, src, sizeof(Pixel));
+			src += sizeof(Pixel);
+			while (run--)
+				dst[x++] = pixel;
+		}
+	}
+
+	return src;
+}
+
+/*
+ * Returns the encoded pixels of a 16 or 32-bit surface (to be freed
+ * with free()) or NULL if the surface is not supported or would not
+ * shrink considerably.
+ */
+void *
+surface_rle_encode(SDL_Surface *surf, size_t *size)
+{
+	int bpp = surf->format->BytesPerPixel;
+	size_t raw = (size_t)surf->w*surf->h*bpp;
+	Uint8 *data, *p;
+
+	if ((bpp != 2 && bpp != 4) || !surf->w || !surf->h)
+		return NULL;
+
+	/* worst case: one header per RLE_MAX_LITERAL pixels */
+	data = (Uint8 *)malloc(raw + (size_t)surf->h *
+			       ((surf->w + RLE_MAX_LITERAL - 1)/RLE_MAX_LITERAL));
+	if (!data)
+		return NULL;
+
+	if (SDL_MUSTLOCK(surf))
+		SDL_LockSurface(surf);
+
+	p = data;
+	for (int y = 0; y < surf->h; y++) {
+		Uint8 *row = (Uint8 *)surf->pixels + y*surf->pitch;
+
+		if (bpp == 2)
+			p = rle_encode_row((Uint16 *)row, surf->w, p);
+		else
+			p = rle_encode_row((Uint32 *)row, surf->w, p);
+	}
+
+	if (SDL_MUSTLOCK(surf))
+		SDL_UnlockSurface(surf);
+
+	*size = p - data;
+	if (*size > raw*3/4) {
+		free(data);
+		return NULL;
+	}
+
+	return realloc(data, *size) ? : data;
+}
+
+/*
+ * Decodes data returned by surface_rle_encode() into surf, which must
+ * have the size and pixel format of the encoded surface
+ */
+void
+surface_rle_decode(const void *data, SDL_Surface *surf)
+{
+	const Uint8 *p = (const Uint8 *)data;
+
+	if (SDL_MUSTLOCK(surf))
+		SDL_LockSurface(surf);
+
+	for (int y = 0; y < surf->h; y++) {
+		Uint8 *row = (Uint8 *)surf->pixels + y*surf->pitch;
+
+		if (surf->format->BytesPerPixel == 2)
+			p = rle_decode_row(p, (Uint16 *)row, surf->w);
+		else
+			p = rle_decode_row(p, (Uint32 *)row, surf->w);
+	}
+
+	if (SDL_MUSTLOCK(surf))
+		SDL_UnlockSurface(surf);
+}
+
+/*
+ * Whether surface_blit_scaled() supports the surfaces' pixel formats:
+ * 32-bit with 8-bit channels and identical RGB layouts, which is the case
+ * for display format surfaces on 32-bit displays.
+ * Colorkeys are not supported, so colorkeyed surfaces must be blitted
+ * by SDL.
+ */
+bool
+surface_can_blit_scaled(SDL_Surface *src, SDL_Surface *dst)
+{
+	SDL_PixelFormat *sf = src->format;
+	SDL_PixelFormat *df = dst->format;
+
+	return !(src->flags & SDL_SRCCOLORKEY) &&
+	       sf->BytesPerPixel == 4 && df->BytesPerPixel == 4 &&
+	       sf->Gmask == G_MASK && (sf->Rmask | sf->Bmask) == RB_MASK &&
+	       sf->Rmask == df->Rmask && sf->Gmask == df->Gmask &&
+	       sf->Bmask == df->Bmask &&
+	       (!sf->Amask || sf->Amask == 0xFF000000);
+}
+
+/*
+ * Interpolates two pairs of 8-bit channels at once (SWAR).
+ * Channels must be masked with RB_MASK, w must be in [0, 256].
+ */
+static inline Uint32
+lerp_lanes(Uint32 l0, Uint32 l1, Uint32 w)
+{
+	return ((l0*(256 - w) + l1*w) >> 8) & RB_MASK;
+}
+
+/*
+ * Source texel coordinates and weight of a 16.16 fixed point position
+ */
+static inline void
+sample_pos(Sint32 s, int size, int &t0, int &t1, Uint32 &f)
+{
+	if (s <= 0) {
+		t0 = t1 = 0;
+		f = 0;
+	} else if ((s >> 16) >= size - 1) {
+		t0 = t1 = size - 1;
+		f = 0;
+	} else {
+		t0 = s >> 16;
+		t1 = t0 + 1;
+		f = (s >> 8) & 0xFF;
+	}
+}
+
+/*
+ * Composites src scaled to w x h pixels at the 16.16 fixed point
+ * position x, y of dst with the given opacity, in a single pass
+ * with bilinear interpolation. No intermediate surfaces are allocated,
+ * so geometry changes are free and sub-pixel positions are possible.
+ * Pixel formats must be supported (see surface_can_blit_scaled()).
+ * The clipping rectangle of dst is respected, the alpha channel of dst
+ * is left unchanged.
+ */
+void
+surface_blit_scaled(SDL_Surface *src, SDL_Surface *dst,
+		    Sint32 x, Sint32 y, int w, int h, Uint8 alpha)
+{
+	const SDL_Rect &clip = dst->clip_rect;
+	Uint32 opacity = alpha + (alpha >> 7);	/* [0, 256] */
+	bool has_alpha = src->format->Amask != 0;
+	Sint32 step_x, step_y, sx1, sy;
+	int x1, y1, x2, y2;
+
+	if (w <= 0 || h <= 0 || !opacity || !src->w || !src->h)
+		return;
+
+	/* destination pixels whose centers are covered */
+	x1 = MAX((x + 0x7FFF) >> 16, clip.x);
+	y1 = MAX((y + 0x7FFF) >> 16, clip.y);
+	x2 = MIN((Sint32)((x + ((Sint64)w << 16) + 0x7FFF) >> 16),
+		 clip.x + clip.w);
+	y2 = MIN((Sint32)((y + ((Sint64)h << 16) + 0x7FFF) >> 16),
+		 clip.y + clip.h);
+	if (x1 >= x2 || y1 >= y2)
+		return;
+
+	step_x = (Sint32)(((Sint64)src->w << 16)/w);
+	step_y = (Sint32)(((Sint64)src->h << 16)/h);
+	/* source position of the first pixel center, relative to texel centers */
+	sx1 = (Sint32)(((((Sint64)x1 << 16) + 0x8000 - x)*step_x) >> 16) - 0x8000;
+	sy = (Sint32)(((((Sint64)y1 << 16) + 0x8000 - y)*step_y) >> 16) - 0x8000;
+
+	if (SDL_MUSTLOCK(src))
+		SDL_LockSurface(src);
+	if (SDL_MUSTLOCK(dst))
+		SDL_LockSurface(dst);
+
+	for (int dy = y1; dy < y2; dy++, sy += step_y) {
+		Uint32 *d = (Uint32 *)((Uint8 *)dst->pixels + dy*dst->pitch) + x1;
+		Uint32 *row0, *row1;
+		Sint32 sx = sx1;
+		int ty0, ty1;
+		Uint32 fy;
+
+		sample_pos(sy, src->h, ty0, ty1, fy);
+		row0 = (Uint32 *)((Uint8 *)src->pixels + ty0*src->pitch);
+		row1 = (Uint32 *)((Uint8 *)src->pixels + ty1*src->pitch);
+
+		for (int dx = x1; dx < x2; dx++, sx += step_x, d++) {
+			Uint32 p00, p01, p10, p11;
+			Uint32 rb, ag, a;
+			int tx0, tx1;
+			Uint32 fx;
+
+			sample_pos(sx, src->w, tx0, tx1, fx);
+			p00 = row0[tx0];
+			p01 = row0[tx1];
+			p10 = row1[tx0];
+			p11 = row1[tx1];
+
+			/* red/blue and alpha/green lanes */
+			rb = lerp_lanes(lerp_lanes(p00 & RB_MASK, p01 & RB_MASK, fx),
+					lerp_lanes(p10 & RB_MASK, p11 & RB_MASK, fx),
+					fy);
+			ag = lerp_lanes(lerp_lanes((p00 >> 8) & RB_MASK,
+						   (p01 >> 8) & RB_MASK, fx),
+					lerp_lanes((p10 >> 8) & RB_MASK,
+						   (p11 >> 8) & RB_MASK, fx),
+					fy);
+
+			a = has_alpha ? ag >> 16 : SDL_ALPHA_OPAQUE;
+			a = (a*opacity) >> 8;
+			a += a >> 7;
+			if (!a)
+				continue;
+
+			if (a < 256) {
+				rb = lerp_lanes(*d & RB_MASK, rb, a);
+				ag = lerp_lanes((*d >> 8) & RB_MASK, ag, a);
+			}
+
+			*d = (*d & ~(RB_MASK | G_MASK)) | rb | ((ag << 8) & G_MASK);
+		}
+	}
+
+	if (SDL_MUSTLOCK(dst))
+		SDL_UnlockSurface(dst);
+	if (SDL_MUSTLOCK(src))
+		SDL_UnlockSurface(src);
+}
+
+/*
+ * Whether surface_fill_blended() supports the surface's pixel format:
+ * 32-bit with 8-bit RGB channels
+ */
+bool
+surface_can_fill_blended(SDL_Surface *dst)
+{
+	SDL_PixelFormat *df = dst->format;
+
+	return df->BytesPerPixel == 4 &&
+	       df->Gmask == G_MASK && (df->Rmask | df->Bmask) == RB_MASK;
+}
+
+/*
+ * Fills rect of dst (clipped to the clipping rectangle) with a color
+ * mapped to the format of dst at the given opacity.
+ * Opaque fills are plain memory fills (SDL_FillRect()), translucent ones
+ * blend the red/blue and green channels in parallel (SWAR) with the
+ * color's share precomputed per fill.
+ * The pixel format must be supported (see surface_can_fill_blended())
+ * for translucent fills. The alpha channel of dst is left unchanged.
+ */
+void
+surface_fill_blended(SDL_Surface *dst, SDL_Rect *rect, Uint32 color,
+		     Uint8 alpha)
+{
+	SDL_Rect r = *rect;
+	Uint32 a = alpha + (alpha >> 7);	/* [0, 256] */
+	Uint32 rb_part, g_part;
+	int x1, y1, x2, y2;
+
+	if (!a)
+		return;
+	if (a == 256) {
+		SDL_FillRect(dst, &r, color);
+		return;
+	}
+
+	x1 = MAX(r.x, dst->clip_rect.x);
+	y1 = MAX(r.y, dst->clip_rect.y);
+	x2 = MIN(r.x + r.w, dst->clip_rect.x + dst->clip_rect.w);
+	y2 = MIN(r.y + r.h, dst->clip_rect.y + dst->clip_rect.h);
+	if (x1 >= x2 || y1 >= y2)
+		return;
+
+	rb_part = (color & RB_MASK)*a;
+	g_part = (color & G_MASK)*a;
+	a = 256 - a;
+
+	if (SDL_MUSTLOCK(dst))
+		SDL_LockSurface(dst);
+
+	for (int y = y1; y < y2; y++) {
+		Uint32 *d = (Uint32 *)((Uint8 *)dst->pixels + y*dst->pitch) + x1;
+		Uint32 *end = d + (x2 - x1);
+
+		for (; d < end; d++) {
+			Uint32 rb = (((*d & RB_MASK)*a + rb_part) >> 8) & RB_MASK;
+			Uint32 g = (((*d & G_MASK)*a + g_part) >> 8) & G_MASK;
+
+			*d = (*d & ~(RB_MASK | G_MASK)) | rb | g;
+		}
+	}
+
+	if (SDL_MUSTLOCK(dst))
+		SDL_UnlockSurface(dst);
+}
+
+/*
+ * Recovers the colors and the alpha channel of a composite from
+ * renderings of it on opaque black and on opaque white (difference
+ * matting): Compositing with the "over" operator adds 255*(1 - alpha)
+ * to every channel of the rendering on white.
+ * All surfaces must have the same size and pixel format, supported by
+ * surface_blit_scaled() and with an alpha channel.
+ * dst may be on_black.
+ */
+void
+surface_unmatte(SDL_Surface *on_black, SDL_Surface *on_white,
+		SDL_Surface *dst)
+{
+	Uint32 ashift = dst->format->Ashift;
+
+	if (SDL_MUSTLOCK(on_black))
+		SDL_LockSurface(on_black);
+	if (SDL_MUSTLOCK(on_white))
+		SDL_LockSurface(on_white);
+	if (dst != on_black && SDL_MUSTLOCK(dst))
+		SDL_LockSurface(dst);
+
+	for (int y = 0; y < dst->h; y++) {
+		Uint32 *b = (Uint32 *)((Uint8 *)on_black->pixels +
+				       y*on_black->pitch);
+		Uint32 *w = (Uint32 *)((Uint8 *)on_white->pixels +
+				       y*on_white->pitch);
+		Uint32 *d = (Uint32 *)((Uint8 *)dst->pixels + y*dst->pitch);
+
+		for (int x = 0; x < dst->w; x++) {
+			/* the green channel is at the same place in all layouts */
+			int diff = (int)((w[x] & G_MASK) >> 8) -
+				   (int)((b[x] & G_MASK) >> 8);
+			Uint32 a = diff > 0 ? 255 - diff : 255;
+			Uint32 c = b[x];
+
+			if (!a) {
+				d[x] = 0;
+				continue;
+			}
+			if (a < 255) {
+				/* colors on black are premultiplied */
+				Uint32 c0 = MIN(((c & 0xFF)*255 + a/2)/a, 255U);
+				Uint32 c1 = MIN((((c >> 8) & 0xFF)*255 + a/2)/a, 255U);
+				Uint32 c2 = MIN((((c >> 16) & 0xFF)*255 + a/2)/a, 255U);
+
+				c = c0 | c1 << 8 | c2 << 16;
+			}
+			d[x] = (c & (RB_MASK | G_MASK)) | a << ashift;
+		}
+	}
+
+	if (dst != on_black && SDL_MUSTLOCK(dst))
+		SDL_UnlockSurface(dst);
+	if (SDL_MUSTLOCK(on_white))
+		SDL_UnlockSurface(on_white);
+	if (SDL_MUSTLOCK(on_black))
+		SDL_UnlockSurface(on_black);
+}
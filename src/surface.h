@@ -0,0 +1,27 @@
+#ifndef __SURFACE_H
+#define __SURFACE_H
+
+#include <SDL.h>
+
+void surface_init(void);
+
+bool surface_is_display_format(SDL_Surface *surf);
+SDL_Surface *surface_display_format(SDL_Surface *surf);
+SDL_Surface *surface_new_alpha(int w, int h);
+
+void *surface_rle_encode(SDL_Surface *surf, size_t *size);
+void surface_rle_decode(const void *data, SDL_Surface *surf);
+
+bool surface_can_blit_scaled(SDL_Surface *src, SDL_Surface *dst);
+void surface_blit_scaled(SDL_Surface *src, SDL_Surface *dst,
+			 Sint32 x, Sint32 y, int w, int h,
+			 Uint8 alpha = SDL_ALPHA_OPAQUE);
+
+void surface_unmatte(SDL_Surface *on_black, SDL_Surface *on_white,
+		     SDL_Surface *dst);
+
+bool surface_can_fill_blended(SDL_Surface *dst);
+void surface_fill_blended(SDL_Surface *dst, SDL_Rect *rect, Uint32 color,
+			  Uint8 alpha = SDL_ALPHA_OPAQUE);
+
+#endif
@@ -0,0 +1,206 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+
+#include "osc_graphics.h"
+#include "font_pool.h"
+#include "surface.h"
+#include "text_canvas.h"
+
+/*
+ * Draws glyph coverage into the alpha channel of an ARGB surface.
+ * Overlapping glyphs are combined by taking the maximum coverage.
+ */
+static void
+draw_glyph(SDL_Surface *surf, const FontPoolGlyph *glyph,
+	   int x, int y, Uint32 rgb)
+{
+	SDL_Surface *mask = glyph->mask;
+	SDL_PixelFormat *fmt = surf->format;
+	int x1 = x < 0 ? -x : 0;
+	int y1 = y < 0 ? -y : 0;
+	int x2 = x + mask->w > surf->w ? surf->w - x : mask->w;
+	int y2 = y + mask->h > surf->h ? surf->h - y : mask->h;
+
+	for (int my = y1; my < y2; my++) {
+		Uint8 *src = (Uint8 *)mask->pixels + my*mask->pitch;
+		Uint32 *dst = (Uint32 *)((Uint8 *)surf->pixels +
+					 (y + my)*surf->pitch) + x;
+
+		for (int mx = x1; mx < x2; mx++) {
+			Uint32 a = src[mx];
+			Uint32 old = (dst[mx] & fmt->Amask) >> fmt->Ashift;
+
+			if (a > old)
+				dst[mx] = rgb | (a << fmt->Ashift);
+		}
+	}
+}
+
+/*
+ * Returns a new surface reference (to be freed with SDL_FreeSurface())
+ * or NULL if the text is empty or cannot be rendered.
+ */
+SDL_Surface *
+TextCanvas::render(FontPoolFont *font, const char *text, SDL_Color color)
+{
+	int len = strlen(text);
+	const FontPoolGlyph **glyphs;
+	int *pen;
+	int w = 1, prefix = 0, draw_start = 0, copy_w = 0;
+	SDL_Surface *surf;
+	Uint32 rgb;
+
+	if (last && font == last_font && !strcmp(text, last_text) &&
+	    !memcmp(&color, &last_color, sizeof(color))) {
+		last->refcount++;
+		return last;
+	}
+
+	if (!len) {
+		originv = advancev = 0;
+		return NULL;
+	}
+
+	if (font->style & TTF_STYLE_UNDERLINE) {
+		/* underlines span the whole string, not single glyphs */
+		reset();
+		font_pool.lock();
+		surf = TTF_RenderText_Blended(font->ttf, text, color);
+		font_pool.unlock();
+		if (!surf)
+			return NULL;
+		originv = 0;
+		advancev = surf->w;
+		return surface_display_format(surf);
+	}
+
+	/*
+	 * Pen positions of the common prefix are unchanged, so they
+	 * are taken from the last composition instead of looking up
+	 * kerning pairs again
+	 */
+	if (last && font == last_font &&
+	    !memcmp(&color, &last_color, sizeof(color)))
+		while (text[prefix] && text[prefix] == last_text[prefix])
+			prefix++;
+
+	glyphs = new const FontPoolGlyph *[len];
+	pen = new int[len + 1];
+	if (prefix)
+		memcpy(pen, last_pen, prefix*sizeof(int));
+
+	font_pool.lock();
+	for (int i = 0; i < len; i++) {
+		glyphs[i] = font_pool.glyph(font, (Uint8)text[i]);
+
+		if (i < prefix)
+			continue;
+		if (!i)
+			pen[0] = glyphs[0]->minx < 0 ? -glyphs[0]->minx : 0;
+		else
+			pen[i] = pen[i - 1] + glyphs[i - 1]->advance +
+				 font_pool.kerning(font, (Uint8)text[i - 1],
+						   (Uint8)text[i]);
+	}
+	pen[len] = pen[len - 1] + glyphs[len - 1]->advance;
+	font_pool.unlock();
+
+	for (int i = 0; i < len; i++) {
+		int right = pen[i] + glyphs[i]->advance;
+
+		if (glyphs[i]->mask &&
+		    pen[i] + glyphs[i]->minx + glyphs[i]->mask->w > right)
+			right = pen[i] + glyphs[i]->minx + glyphs[i]->mask->w;
+		if (right > w)
+			w = right;
+	}
+
+	surf = surface_new_alpha(w, font->height);
+	if (!surf) {
+		delete[] glyphs;
+		delete[] pen;
+		return NULL;
+	}
+	rgb = SDL_MapRGBA(surf->format, color.r, color.g, color.b,
+			  SDL_ALPHA_TRANSPARENT);
+
+	/*
+	 * Pixels of the common prefix are copied from the last
+	 * composition. The previous glyph is redrawn as well, since it
+	 * may overhang into the changed part.
+	 */
+	if (prefix) {
+		draw_start = prefix > 1 ? prefix - 2 : 0;
+		copy_w = pen[prefix - 1];
+		if (copy_w > last->w)
+			copy_w = last->w;
+		if (copy_w > w)
+			copy_w = w;
+	}
+
+	SDL_LockSurface(surf);
+
+	for (int y = 0; y < surf->h; y++) {
+		Uint32 *row = (Uint32 *)((Uint8 *)surf->pixels + y*surf->pitch);
+		int x = 0;
+
+		if (copy_w) {
+			memcpy(row, (Uint8 *)last->pixels + y*last->pitch,
+			       copy_w*sizeof(Uint32));
+			x = copy_w;
+		}
+		for (; x < surf->w; x++)
+			row[x] = rgb;
+	}
+
+	for (int i = draw_start; i < len; i++)
+		if (glyphs[i]->mask)
+			draw_glyph(surf, glyphs[i],
+				   pen[i] + glyphs[i]->minx,
+				   font->ascent - glyphs[i]->maxy, rgb);
+
+	SDL_UnlockSurface(surf);
+
+	delete[] glyphs;
+
+	/* keep composition for the next update */
+	if (font != last_font) {
+		font_pool.ref(font);
+		if (last_font)
+			font_pool.release(last_font);
+		last_font = font;
+	}
+	SDL_FREESURFACE_SAFE(last);
+	last = surf;
+	last->refcount++;
+	free(last_text);
+	last_text = strdup(text);
+	delete[] last_pen;
+	last_pen = pen;
+	last_color = color;
+	originv = pen[0];
+	advancev = pen[len] - pen[0];
+
+	return surf;
+}
+
+void
+TextCanvas::reset()
+{
+	SDL_FREESURFACE_SAFE(last);
+	free(last_text);
+	last_text = NULL;
+	delete[] last_pen;
+	last_pen = NULL;
+	if (last_font) {
+		font_pool.release(last_font);
+		last_font = NULL;
+	}
+}
@@ -0,0 +1,53 @@
+#ifndef __TEXT_CANVAS_H
+#define __TEXT_CANVAS_H
+
+#include <SDL.h>
+
+#include "osc_graphics.h"
+#include "font_pool.h"
+
+/*
+ * Composes Latin-1 strings from glyphs cached by the font pool
+ * (instead of rasterizing them with TTF_RenderText_Blended()).
+ * The last composition is kept, so updates that only change the end of
+ * a string (counters, clocks) draw only the changed glyphs.
+ * Returned surfaces are never modified afterwards.
+ */
+class TextCanvas {
+	SDL_Surface	*last;
+	char		*last_text;
+	int		*last_pen;	/* pen positions of last_text */
+	FontPoolFont	*last_font;
+	SDL_Color	last_color;
+
+	int		originv, advancev;
+
+public:
+	TextCanvas() : last(NULL), last_text(NULL), last_pen(NULL),
+		       last_font(NULL), originv(0), advancev(0) {}
+	~TextCanvas()
+	{
+		reset();
+	}
+
+	SDL_Surface *render(FontPoolFont *font, const char *text,
+			    SDL_Color color);
+	void reset();
+
+	/*
+	 * Pen position of the first glyph in the last rendered surface
+	 * and total advance of the text (without overhangs)
+	 */
+	inline int
+	origin() const
+	{
+		return originv;
+	}
+	inline int
+	advance() const
+	{
+		return advancev;
+	}
+};
+
+#endif
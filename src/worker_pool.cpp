@@ -0,0 +1,136 @@
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <bsd/sys/queue.h>
+
+#include <SDL.h>
+#include <SDL_thread.h>
+
+#include "osc_graphics.h"
+#include "worker_pool.h"
+
+WorkerPool::WorkerPool() : Mutex(), num_threads(0), threads(NULL),
+			   running(NULL), next_thread_id(0), quit(false)
+{
+	TAILQ_INIT(&queue);
+}
+
+void
+WorkerPool::start(int threads_count)
+{
+	if (threads_count < 1)
+		threads_count = 1;
+
+	num_threads = threads_count;
+	threads = new SDL_Thread *[num_threads];
+	running = new void *[num_threads];
+
+	for (int i = 0; i < num_threads; i++) {
+		running[i] = NULL;
+		threads[i] = SDL_CreateThread(thread_main, this);
+		if (!threads[i]) {
+			SDL_ERROR("SDL_CreateThread");
+			exit(EXIT_FAILURE);
+		}
+	}
+}
+
+int
+WorkerPool::thread_main(void *data)
+{
+	WorkerPool *pool = (WorkerPool *)data;
+	int id;
+
+	pool->lock();
+	id = pool->next_thread_id++;
+
+	for (;;) {
+		Job *job;
+
+		while (!pool->quit && TAILQ_EMPTY(&pool->queue))
+			pool->queue_cond.wait(*pool);
+		if (pool->quit)
+			break;
+
+		job = TAILQ_FIRST(&pool->queue);
+		TAILQ_REMOVE(&pool->queue, job, jobs);
+		pool->running[id] = job->owner;
+		pool->unlock();
+
+		job->run();
+		delete job;
+
+		pool->lock();
+		pool->running[id] = NULL;
+		pool->done_cond.broadcast();
+	}
+
+	pool->unlock();
+	return 0;
+}
+
+void
+WorkerPool::push(Job *job)
+{
+	lock();
+	TAILQ_INSERT_TAIL(&queue, job, jobs);
+	queue_cond.signal();
+	unlock();
+}
+
+/*
+ * Remove all queued jobs of owner and wait for its running jobs
+ * to finish.
+ * Must not be called with locks held that the owner's jobs might acquire.
+ */
+void
+WorkerPool::cancel(void *owner)
+{
+	Job *job, *next;
+	bool busy;
+
+	lock();
+
+	for (job = TAILQ_FIRST(&queue); job; job = next) {
+		next = TAILQ_NEXT(job, jobs);
+
+		if (job->owner == owner) {
+			TAILQ_REMOVE(&queue, job, jobs);
+			delete job;
+		}
+	}
+
+	do {
+		busy = false;
+		for (int i = 0; i < num_threads; i++)
+			busy |= running[i] == owner;
+
+		if (busy)
+			done_cond.wait(*this);
+	} while (busy);
+
+	unlock();
+}
+
+WorkerPool::~WorkerPool()
+{
+	lock();
+	quit = true;
+	queue_cond.broadcast();
+	unlock();
+
+	for (int i = 0; i < num_threads; i++)
+		SDL_WaitThread(threads[i], NULL);
+
+	while (!TAILQ_EMPTY(&queue)) {
+		Job *job = TAILQ_FIRST(&queue);
+
+		TAILQ_REMOVE(&queue, job, jobs);
+		delete job;
+	}
+
+	delete[] running;
+	delete[] threads;
+}
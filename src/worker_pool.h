@@ -0,0 +1,61 @@
+#ifndef __WORKER_POOL_H
+#define __WORKER_POOL_H
+
+#include <bsd/sys/queue.h>
+
+#include <SDL.h>
+#include <SDL_thread.h>
+
+#include "osc_graphics.h"
+
+/*
+ * Pool of background threads for expensive operations (image decoding,
+ * scaling, etc.) that must block neither the OSC server thread nor the
+ * render loop
+ */
+class WorkerPool : Mutex {
+public:
+	/*
+	 * Jobs are allocated by the submitter and deleted by the pool
+	 * after they have been run or cancelled
+	 */
+	class Job {
+		friend class WorkerPool;
+
+		TAILQ_ENTRY(Job) jobs;
+
+	public:
+		void *owner;
+
+		Job(void *_owner = NULL) : owner(_owner) {}
+		virtual ~Job() {}
+
+		virtual void run() = 0;
+	};
+
+private:
+	TAILQ_HEAD(jobs_head, Job) queue;
+	Cond queue_cond;	/* signalled when a job is queued */
+	Cond done_cond;		/* signalled when a job has been run */
+
+	int num_threads;
+	SDL_Thread **threads;
+	void **running;		/* owner of job run by each thread */
+	int next_thread_id;
+	bool quit;
+
+	static int thread_main(void *data);
+
+public:
+	WorkerPool();
+	~WorkerPool();
+
+	void start(int threads);
+
+	void push(Job *job);
+	void cancel(void *owner);
+};
+
+extern WorkerPool worker_pool;
+
+#endif